@@ -4,25 +4,75 @@
 #include <onix/types.h>
 #include <onix/list.h>
 
-#define DESC_COUNT 7
+#define DESC_COUNT 13
 typedef list_node_t block_t;
 
+// 定义 ARENA_DEBUG 时 kfree 检查块的合法性，开销是 O(n) 的
+// 定义 ARENA_STAT 时统计每一级的分配次数和峰值
+// 定义 ARENA_TRACK 时记录每次分配的调用位置，用于查找泄漏
+
+typedef struct arena_class_stat_t
+{
+  u32 allocs;      // 分配次数
+  u32 frees;       // 释放次数
+  u32 live;        // 使用中的块数，大块内存为页数
+  u32 peak;        // live 的最大值
+  u32 arenas;      // 持有的 arena 数
+  u32 arenas_peak; // arenas 的最大值
+} arena_class_stat_t;
+
 typedef struct arena_descriptor_t
 {
-  u32 total_block;  // 一页分成了多少块
+  u32 total_block;  // 一个 arena 分成了多少块
   u32 block_size;   // 块大小
-  list_t free_list;
+  u32 pages;        // 一个 arena 的页数
+  list_t partial;   // 还有空闲块的 arena
+  list_t full;      // 没有空闲块的 arena
+  list_t empty;     // 缓存的全部空闲的 arena
+  u32 empty_count;  // 缓存的空 arena 数
+  u32 requested;    // 累计请求的字节数
+  u32 allocated;    // 累计分配的块字节数
+#ifdef ARENA_STAT
+  arena_class_stat_t stat;
+#endif
 } arena_descriptor_t;
 
 typedef struct arena_t
 {
   arena_descriptor_t *desc;
-  u32 count;
+  u32 count;         // 空闲块数，大块内存为页数
   u32 large;
   u32 magic;
+  list_node_t node;  // 挂在描述符的 partial/full 链表上
+  list_t free_list;  // 释放过的空闲块
+  u32 unused;        // 还没有分配过的块数
+  void *base;        // 第一个块的地址
 } arena_t;
 
 void *kmalloc(size_t size);
 void kfree(void *ptr);
 
+// 调整 ptr 的大小，能放下时原地调整，否则复制到新的内存
+void *krealloc(void *ptr, size_t size);
+
+// 批量分配和释放，同一个 arena 中的块一次取出或放回
+void kmalloc_batch(size_t size, void **ptrs, u32 count);
+void kfree_batch(void **ptrs, u32 count);
+
+// 每一级缓存的空 arena 数量
+extern u32 arena_empty_keep;
+
+// 释放缓存的空 arena，返回释放的页数，内核页不够时调用
+u32 arena_shrink();
+
+// 打印每一级 kmalloc 的使用情况，定义 ARENA_TRACK 时同时打印未释放的分配
+void arena_stat();
+
+// 检查 krealloc 和批量分配释放，内存有泄漏或内容被破坏时断言失败
+void arena_test();
+
+#ifdef ARENA_TRACK
+void arena_track_dump();
+#endif
+
 #endif
\ No newline at end of file
@@ -3,11 +3,15 @@
 
 #include <onix/types.h>
 
+// 摘要字数，每一位对应位图中的一个 32 位字，最多支持 4K 字节的位图
+#define BITMAP_SUMMARY_WORDS 32
+
 typedef struct bitmap_t
 {
     u8 *bits;   // 位图缓冲区
     u32 length; // 位图缓冲区长度
     u32 offset; // 位图开始的偏移
+    u32 summary[BITMAP_SUMMARY_WORDS]; // 摘要，置位表示对应的字还有空闲位
 } bitmap_t;
 
 // 初始化位图
@@ -22,6 +26,12 @@ bool bitmap_test(bitmap_t *map, u32 index);
 // 设置位图某位的值
 void bitmap_set(bitmap_t *map, u32 index, bool value);
 
+// 将 index 开始的 count 位置为 1
+void bitmap_set_range(bitmap_t *map, u32 index, u32 count);
+
+// 将 index 开始的 count 位置为 0
+void bitmap_clear_range(bitmap_t *map, u32 index, u32 count);
+
 // 从位图中得到连续的 count 位
 int bitmap_scan(bitmap_t *map, u32 count);
 
@@ -1,6 +1,7 @@
 #ifndef ONIX_MEMORY_H
 #define ONIX_MEMORY_H
 #include <onix/types.h>
+#include <onix/list.h>
 
 #define KERNEL_PAGE_DIR 0x1000
 #define PAGE_SIZE 0x1000     // 一页的大小 4K
@@ -9,6 +10,13 @@
 // 内核占用的内存大小 8M
 #define KERNEL_MEMORY_SIZE 0x800000
 
+// 临时映射窗口，位于页目录自映射之下，所有进程共享
+#define KMAP_BASE 0xFF800000
+#define KMAP_SLOTS 32 // 临时映射槽位数
+
+// 用户堆从内核内存之后开始，第一页保存 malloc 的状态
+#define USER_HEAP_START (KERNEL_MEMORY_SIZE + PAGE_SIZE)
+
 // 用户栈顶地址 128M
 #define USER_STACK_TOP 0x8000000
 
@@ -33,6 +41,28 @@ typedef struct page_entry_t
     u32 index : 20;  // 页索引
 } _packed page_entry_t;
 
+// 物理页标志
+#define PG_RESERVED 0x01 // 保留页，不参与分配
+#define PG_BUDDY 0x02    // 伙伴系统空闲块的首页
+#define PG_ZERO 0x04     // 全零页，只读共享
+#define PG_ZEROED 0x08   // 已清零，在清零页池中
+
+// 物理页描述符，每个物理页一个
+typedef struct page_t
+{
+    u32 count;            // 引用计数
+    u32 flags;            // 页标志
+    list_node_t node;     // 链表结点，空闲时挂在伙伴系统的空闲链表上
+    u32 order;            // 空闲块的阶数
+    struct task_t *owner; // 第一次映射该页的进程
+    u32 vaddr;            // 映射的虚拟地址
+    void *private;        // 内核页使用者的私有数据，如 kmalloc 的 arena
+} page_t;
+
+// 物理页索引和描述符的转换
+page_t *pfn_to_page(u32 idx);
+u32 page_to_pfn(page_t *page);
+
 // 得到 cr2 寄存器
 u32 get_cr2();
 
@@ -42,6 +72,38 @@ void set_cr3(u32 pde);
 void free_kpage(u32 vaddr, u32 count);
 u32 alloc_kpage(u32 count);
 
+// 把 count 个内核页原地扩展到 new_count 个，失败返回 false
+bool grow_kpage(u32 vaddr, u32 count, u32 new_count);
+
+// 获取一个清零的内核页，优先从清零页池中取
+u32 alloc_zero_kpage();
+
+// 空闲进程调用，清零一页放入池中，没有工作时返回 false
+bool zero_pool_refill();
+
+// 清零页池命中和未命中的次数
+extern u32 zero_pool_hits;
+extern u32 zero_pool_misses;
+
+// 临时映射物理页，返回内核虚拟地址，用完之后必须 kunmap
+void *kmap(u32 paddr);
+void kunmap(void *vaddr);
+
+// 一次批量刷新快表的最大页数，超过则直接重新加载 cr3
+#define TLB_BATCH_SIZE 32
+
+// 快表批量刷新
+typedef struct tlb_batch_t
+{
+    u32 count;                 // 需要刷新的页数
+    u32 vaddr[TLB_BATCH_SIZE]; // 需要刷新的虚拟地址
+} tlb_batch_t;
+
+void tlb_batch_init(tlb_batch_t *batch);
+void tlb_batch_add(tlb_batch_t *batch, u32 vaddr);
+void tlb_batch_add_range(tlb_batch_t *batch, u32 vaddr, u32 count);
+void tlb_batch_flush(tlb_batch_t *batch);
+
 // 将 vaddr 映射物理内存
 void link_page(u32 vaddr);
 // 去掉 vaddr 对应的物理内存映射
@@ -52,6 +114,12 @@ page_entry_t *copy_pde();
 // 释放页目录
 void free_pde();
 
+// 缺页时一起映射的窗口页数，必须是 2 的幂
+extern u32 fault_around_pages;
+
+// 内核写用户内存之前调用，写时复制的页先复制
+void prepare_user_write(void *addr, u32 size);
+
 // 系统调用 brk
 int32 sys_brk(void *addr);
 
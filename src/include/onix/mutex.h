@@ -12,6 +12,7 @@ typedef struct mutex_t
 
 void mutex_init(mutex_t *mutex);   // 初始化互斥量
 void mutex_lock(mutex_t *mutex);   // 尝试持有互斥量
+bool mutex_lock_timeout(mutex_t *mutex, u32 ms); // 最多等待 ms 毫秒，超时返回 false
 void mutex_unlock(mutex_t *mutex); // 释放互斥量
 
 typedef struct lock_t
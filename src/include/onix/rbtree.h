@@ -0,0 +1,38 @@
+#ifndef ONIX_RBTREE_H
+#define ONIX_RBTREE_H
+
+#include <onix/types.h>
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+// 红黑树结点，嵌入到需要排序的结构体中
+typedef struct rb_node_t
+{
+    struct rb_node_t *parent;
+    struct rb_node_t *left;
+    struct rb_node_t *right;
+    u32 color;
+} rb_node_t;
+
+// 红黑树
+typedef struct rb_root_t
+{
+    rb_node_t *node;     // 根结点
+    rb_node_t *leftmost; // 最小的结点
+} rb_root_t;
+
+// 初始化红黑树
+void rb_init(rb_root_t *root);
+
+// 由调用者比较找到位置 link 及其父结点 parent 后，插入结点 node 并平衡
+// leftmost 表示插入的是否是最小结点
+void rb_insert(rb_root_t *root, rb_node_t *node, rb_node_t *parent, rb_node_t **link, bool leftmost);
+
+// 删除结点 node
+void rb_erase(rb_root_t *root, rb_node_t *node);
+
+// 中序遍历的下一个结点
+rb_node_t *rb_next(rb_node_t *node);
+
+#endif
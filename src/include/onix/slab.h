@@ -0,0 +1,36 @@
+#ifndef ONIX_SLAB_H
+#define ONIX_SLAB_H
+
+#include <onix/types.h>
+#include <onix/list.h>
+
+#define CACHE_LINE_SIZE 64 // 对象按缓存行对齐
+#define CACHE_NAME_LEN 16
+#define CACHE_PAGES 16 // 整页对象缓存的空闲页数
+
+typedef void ctor_t(void *obj);
+
+// 对象缓存
+// 小对象按缓存行对齐放在 slab 页中，构造函数只在 slab 创建时调用
+// 整页对象(size == PAGE_SIZE)新页是清零的，释放后缓存在 pages 中
+// 释放对象时需要恢复到构造之后的状态
+typedef struct kmem_cache_t
+{
+  char name[CACHE_NAME_LEN];
+  u32 size;       // 对齐之后的对象大小
+  u32 count;      // 每个 slab 的对象数，整页对象为 0
+  u32 offset;     // slab 中第一个对象的偏移
+  ctor_t *ctor;   // 构造函数
+  list_t partial; // 部分使用的 slab
+  list_t full;    // 全部使用的 slab
+  list_t empty;   // 全部空闲的 slab
+  u32 empty_count;
+  u32 pages[CACHE_PAGES]; // 空闲的整页对象
+  u32 page_count;
+} kmem_cache_t;
+
+kmem_cache_t *kmem_cache_create(const char *name, u32 size, ctor_t *ctor);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+#endif
@@ -13,4 +13,8 @@ u8 bcd_to_bin(u8 value);
 u8 bin_to_bcd(u8 value);
 
 u32 div_round_up(u32 num, u32 size);
+
+// 用户态堆内存分配，基于 brk
+void *malloc(size_t size);
+void free(void *ptr);
 #endif
\ No newline at end of file
@@ -3,11 +3,15 @@
 
 #include <onix/types.h>
 #include <onix/list.h>
+#include <onix/rbtree.h>
 
 #define KERNEL_USER 0
 #define NORMAL_USER 1
 #define TASK_NAME_LEN 16
 
+#define SCHED_PRIO 0 // 按优先级轮转，内核线程使用，先于 SCHED_FAIR 执行
+#define SCHED_FAIR 1 // 按 vruntime 公平调度，用户进程使用
+
 typedef void target_t();
 
 typedef enum task_state_t
@@ -37,6 +41,15 @@ typedef struct task_t
     struct bitmap_t *vmap;   // 进程虚拟内存位图
     u32 brk;                  // 进程堆内存最高地址
     int status;               // 进程特殊状态
+    struct task_t *vparent;   // spawn 时被挂起的父进程，子进程借用其地址空间
+    u32 fault_around_mapped;  // 缺页时预先映射的页数，不一定都会被访问
+    u32 policy;               // 调度策略
+    u32 vruntime;             // 按优先级加权的运行时间，SCHED_FAIR 使用
+    rb_node_t rb;             // SCHED_FAIR 就绪任务红黑树结点
+    struct task_t *hash_next; // pid 散列表中的下一个任务
+    list_t children;          // 子进程链表
+    list_node_t sibling;      // 挂在父进程的 children 链表上
+    pid_t waitpid;            // waitpid 等待的子进程，-1 为任意子进程，0 为没有等待
     u32 magic;               // 内核魔数，用于检测栈溢出
 } task_t;
 
@@ -84,17 +97,25 @@ typedef struct intr_frame_t
 void task_init();
 
 task_t *running_task();
+task_t *task_lookup(pid_t pid);
 void schedule();
 
 void task_exit(int status);
 pid_t task_fork();
+pid_t task_spawn(target_t start);
+pid_t task_waitpid(pid_t pid, int32 *status);
 void task_yield();
 
 void task_block(task_t *task, list_t *blist, task_state_t state);
 void task_unblock(task_t *task);
 
 void task_sleep(u32 ms);
-void task_wakeup();
+bool task_block_timeout(task_t *task, list_t *blist, task_state_t state, u32 ticks);
+
+// 时钟中断中更新当前任务的时间片和运行时间
+void task_tick(task_t *task);
+// 中断处理结束前调用，唤醒的任务需要抢占当前任务时调度
+void task_preempt();
 
 void task_to_user_mode(target_t target);
 
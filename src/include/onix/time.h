@@ -20,4 +20,7 @@ void time_read_bcd(tm *time);
 void time_read(tm *time);
 time_t mktime(tm *time);
 
+// 读取时间戳计数器
+u64 rdtsc();
+
 #endif
\ No newline at end of file
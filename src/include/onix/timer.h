@@ -0,0 +1,45 @@
+#ifndef ONIX_TIMER_H
+#define ONIX_TIMER_H
+
+#include <onix/types.h>
+#include <onix/list.h>
+
+struct timer_t;
+typedef void timer_func_t(struct timer_t *timer);
+
+// 内核定时器，到期时在时钟中断中调用 func
+typedef struct timer_t
+{
+    list_node_t node;   // 挂在时间轮的槽上
+    u32 expires;        // 到期的 jiffies
+    timer_func_t *func; // 到期时的回调
+    void *data;         // 回调使用的数据
+} timer_t;
+
+void timer_init(); // 初始化时间轮
+
+// 初始化定时器，还没有加入时间轮
+void timer_setup(timer_t *timer, timer_func_t *func, void *data);
+
+// 加入时间轮，在 jiffies 等于 expires 的时钟中断中到期
+void timer_add(timer_t *timer, u32 expires);
+
+// 从时间轮中删除，定时器没有等待时什么也不做
+void timer_del(timer_t *timer);
+
+// 修改到期时间
+void timer_mod(timer_t *timer, u32 expires);
+
+// 定时器是否在时间轮中等待
+bool timer_pending(timer_t *timer);
+
+// 时钟中断中调用，处理到 jiffies 为止到期的定时器
+void timer_run();
+
+// 从 jiffies 开始的 max 个时钟周期内，第一个需要处理定时器的周期偏移，没有返回 max
+u32 timer_next(u32 max);
+
+// 检查时间轮每一层的到期时间，在开中断之前调用
+void timer_test();
+
+#endif
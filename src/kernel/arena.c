@@ -3,121 +3,717 @@
 #include <onix/string.h>
 #include <onix/stdlib.h>
 #include <onix/assert.h>
+#include <onix/debug.h>
+#include <onix/printk.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+// 大于这个大小的块，arena 头另外分配，块占满整个 arena
+#define ARENA_OFFSLAB_SIZE 1024
 
 extern u32 free_pages;
 static arena_descriptor_t descriptors[DESC_COUNT];
 
+// 每一级缓存的空 arena 数量，避免在 arena 边界反复申请释放页
+u32 arena_empty_keep = 2;
+
+#ifdef ARENA_STAT
+static arena_class_stat_t large_stat; // 大块内存，以页计数
+#endif
+
+#ifdef ARENA_TRACK
+#define TRACK_SIZE 512
+#define TRACK_DELETED ((void *)1)
+
+// 分配记录，按地址散列，线性探测
+typedef struct track_t
+{
+  void *ptr;    // 分配的地址
+  void *caller; // 调用 kmalloc 的位置
+  u32 size;     // 请求的大小
+} track_t;
+
+static track_t tracks[TRACK_SIZE];
+static u32 track_lost; // 表满时没有记录的分配数
+
+static void track_add(void *ptr, u32 size, void *caller)
+{
+  u32 idx = ((u32)ptr >> 4) % TRACK_SIZE;
+  for (size_t i = 0; i < TRACK_SIZE; i++, idx = (idx + 1) % TRACK_SIZE)
+  {
+    track_t *track = &tracks[idx];
+    if (track->ptr == NULL || track->ptr == TRACK_DELETED)
+    {
+      track->ptr = ptr;
+      track->caller = caller;
+      track->size = size;
+      return;
+    }
+  }
+  track_lost++;
+}
+
+static void track_del(void *ptr)
+{
+  u32 idx = ((u32)ptr >> 4) % TRACK_SIZE;
+  for (size_t i = 0; i < TRACK_SIZE; i++, idx = (idx + 1) % TRACK_SIZE)
+  {
+    track_t *track = &tracks[idx];
+    if (track->ptr == NULL)
+      return;
+    if (track->ptr == ptr)
+    {
+      track->ptr = TRACK_DELETED;
+      return;
+    }
+  }
+}
+
+// 打印所有还没有释放的分配
+void arena_track_dump()
+{
+  u32 count = 0;
+  for (size_t i = 0; i < TRACK_SIZE; i++)
+  {
+    track_t *track = &tracks[i];
+    if (track->ptr == NULL || track->ptr == TRACK_DELETED)
+      continue;
+    printk("  0x%p size %d caller 0x%p\n", track->ptr, track->size, track->caller);
+    count++;
+  }
+  printk("outstanding %d lost %d\n", count, track_lost);
+}
+#endif
+
+// 分配计数，desc 为 NULL 时是大块内存，count 为页数
+static void stat_alloc(arena_descriptor_t *desc, u32 count)
+{
+#ifdef ARENA_STAT
+  arena_class_stat_t *stat = desc ? &desc->stat : &large_stat;
+  stat->allocs++;
+  stat->live += count;
+  if (stat->live > stat->peak)
+    stat->peak = stat->live;
+#endif
+}
+
+static void stat_free(arena_descriptor_t *desc, u32 count)
+{
+#ifdef ARENA_STAT
+  arena_class_stat_t *stat = desc ? &desc->stat : &large_stat;
+  stat->frees++;
+  stat->live -= count;
+#endif
+}
+
+static void stat_arena(arena_descriptor_t *desc, int delta)
+{
+#ifdef ARENA_STAT
+  desc->stat.arenas += delta;
+  if (desc->stat.arenas > desc->stat.arenas_peak)
+    desc->stat.arenas_peak = desc->stat.arenas;
+#endif
+}
+
+// 每一级的块大小，以及每个 arena 的页数，页数选择使块正好占满 arena
+static u32 class_size[DESC_COUNT] = {
+    16, 32, 64, 128, 256, 512, 1024, 1536, 2048, 3072, 4096, 6144, 8192};
+static u32 class_pages[DESC_COUNT] = {
+    1, 1, 1, 1, 1, 1, 1, 3, 1, 3, 1, 3, 2};
+
 void arena_init()
 {
-  u32 block_size = 16;
   for (size_t i = 0; i < DESC_COUNT; i++)
   {
     arena_descriptor_t *desc = &descriptors[i];
-    desc->block_size = block_size;
-    desc->total_block = (PAGE_SIZE - sizeof(arena_t)) / block_size;
-    list_init(&desc->free_list);
-    block_size <<= 1;
+    desc->block_size = class_size[i];
+    desc->pages = class_pages[i];
+    if (desc->block_size > ARENA_OFFSLAB_SIZE)
+    {
+      desc->total_block = desc->pages * PAGE_SIZE / desc->block_size;
+    }
+    else
+    {
+      desc->total_block = (PAGE_SIZE - sizeof(arena_t)) / desc->block_size;
+    }
+    list_init(&desc->partial);
+    list_init(&desc->full);
+    list_init(&desc->empty);
+    desc->empty_count = 0;
   }
 }
 
 static void *get_arena_block(arena_t *arena, u32 idx)
 {
   assert(arena->desc->total_block > idx);
-  void *addr = (void *)(arena + 1);
   u32 gap = idx * arena->desc->block_size;
-  return addr + gap;
+  return arena->base + gap;
+}
+
+// 记录 arena 占用的内核页，用于从块找到 arena
+static void set_arena_pages(arena_t *arena, void *base, u32 count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    pfn_to_page(((u32)base >> 12) + i)->private = arena;
+  }
 }
 
 static arena_t *get_block_arena(block_t *block)
 {
-  return (arena_t *)((u32)block & 0xfffff000);
+  return (arena_t *)pfn_to_page((u32)block >> 12)->private;
 }
 
-void *kmalloc(size_t size)
+// 新建小块内存的 arena，块在第一次分配时才从 unused 中切出
+static arena_t *arena_create(arena_descriptor_t *desc)
 {
-  arena_descriptor_t *desc = NULL;
   arena_t *arena;
-  block_t *block;
-  char *addr;
-  if (size > 1024)
+  void *base;
+  if (desc->block_size > ARENA_OFFSLAB_SIZE)
+  {
+    // 块不需要清零，arena 头放在小块内存中
+    base = (void *)alloc_kpage(desc->pages);
+    arena = kmalloc(sizeof(arena_t));
+  }
+  else
   {
-    u32 asize = size + sizeof(arena_t);
-    u32 count = div_round_up(asize, PAGE_SIZE);
+    arena = (arena_t *)alloc_zero_kpage();
+    base = (void *)(arena + 1);
+  }
+  arena->desc = desc;
+  arena->large = false;
+  arena->count = desc->total_block;
+  arena->unused = desc->total_block;
+  arena->base = base;
+  arena->magic = ONIX_MAGIC;
+  list_init(&arena->free_list);
+  set_arena_pages(arena, (void *)((u32)base & 0xfffff000), desc->pages);
+  stat_arena(desc, 1);
+  return arena;
+}
 
-    arena = (arena_t *)alloc_kpage(count);
-    memset(arena, 0, count * PAGE_SIZE);
-    arena->large = true;
-    arena->count = count;
-    arena->desc = NULL;
-    arena->magic = ONIX_MAGIC;
-    addr = (char *)((u32)arena + sizeof(arena_t));
-    return addr;
+// 释放整个 arena
+static void arena_destroy(arena_t *arena)
+{
+  arena_descriptor_t *desc = arena->desc;
+  stat_arena(desc, -1);
+  if (desc->block_size > ARENA_OFFSLAB_SIZE)
+  {
+    free_kpage((u32)arena->base, desc->pages);
+    kfree(arena);
   }
+  else
+  {
+    free_kpage((u32)arena, 1);
+  }
+}
 
+// 找到能放下 size 的描述符，大块内存返回 NULL
+static arena_descriptor_t *get_descriptor(size_t size)
+{
   for (size_t i = 0; i < DESC_COUNT; i++)
   {
-    desc = &descriptors[i];
-    if (desc->block_size >= size)
+    if (descriptors[i].block_size >= size)
     {
-      break;
+      return &descriptors[i];
     }
   }
-  assert(desc != NULL);
+  return NULL;
+}
 
-  if (list_empty(&desc->free_list))
+// 分配 count 页的大块内存
+static void *large_alloc(u32 count)
+{
+  arena_t *arena;
+  if (count == 1)
   {
-    arena = (arena_t *)alloc_kpage(1);
-    memset(arena, 0, PAGE_SIZE);
-    arena->desc = desc;
-    arena->large = false;
-    arena->count = desc->total_block;
-    arena->magic = ONIX_MAGIC;
-    
-    for (size_t i = 0; i < desc->total_block; i++)
-    {
-      block = get_arena_block(arena, i);
-      assert(!list_search(&arena->desc->free_list, block));
-      list_push(&arena->desc->free_list, block);
-      assert(list_search(&arena->desc->free_list, block));
-    }
+    arena = (arena_t *)alloc_zero_kpage();
+  }
+  else
+  {
+    arena = (arena_t *)alloc_kpage(count);
+    memset(arena, 0, count * PAGE_SIZE);
+  }
+  arena->large = true;
+  arena->count = count;
+  arena->desc = NULL;
+  arena->magic = ONIX_MAGIC;
+  set_arena_pages(arena, arena, count);
+  stat_alloc(NULL, count);
+  return (void *)((u32)arena + sizeof(arena_t));
+}
+
+static u32 large_pages(size_t size)
+{
+  return div_round_up(size + sizeof(arena_t), PAGE_SIZE);
+}
+
+// 得到一个有空闲块的 arena，放在 partial 链表头
+static arena_t *get_free_arena(arena_descriptor_t *desc)
+{
+  arena_t *arena;
+  if (!list_empty(&desc->partial))
+  {
+    arena = element_entry(arena_t, node, desc->partial.head.next);
+  }
+  else if (!list_empty(&desc->empty))
+  {
+    // 复用缓存的空 arena，其中的块不需要重新切分
+    arena = element_entry(arena_t, node, list_pop(&desc->empty));
+    desc->empty_count--;
+    list_insert_after(&desc->partial.head, &arena->node);
+  }
+  else
+  {
+    arena = arena_create(desc);
+    list_insert_after(&desc->partial.head, &arena->node);
   }
+  assert(arena->magic == ONIX_MAGIC && !arena->large && arena->count > 0);
+  return arena;
+}
 
-  block = list_pop(&desc->free_list);
-  arena = get_block_arena(block);
-  assert(arena->magic == ONIX_MAGIC && !arena->large);
+// 从 arena 中取出一块
+static block_t *arena_take(arena_t *arena)
+{
+  arena_descriptor_t *desc = arena->desc;
+  block_t *block;
+  if (!list_empty(&arena->free_list))
+  {
+    block = list_pop(&arena->free_list);
+  }
+  else
+  {
+    assert(arena->unused > 0);
+    block = get_arena_block(arena, desc->total_block - arena->unused);
+    arena->unused--;
+  }
   // memset(block, 0, desc->block_size);
   arena->count--;
+  stat_alloc(desc, 1);
   return block;
 }
 
-void kfree(void *ptr)
+// arena 用完了，移到 full 链表
+static void arena_drained(arena_t *arena)
 {
-  assert(ptr);
+  if (!arena->count)
+  {
+    list_remove(&arena->node);
+    list_insert_after(&arena->desc->full.head, &arena->node);
+  }
+}
+
+static void *arena_alloc(size_t size)
+{
+  arena_descriptor_t *desc = get_descriptor(size);
+  if (!desc)
+  {
+    return large_alloc(large_pages(size));
+  }
+
+  arena_t *arena = get_free_arena(desc);
+  block_t *block = arena_take(arena);
+  desc->requested += size;
+  desc->allocated += desc->block_size;
+  arena_drained(arena);
+  return block;
+}
+
+void *kmalloc(size_t size)
+{
+  void *ptr = arena_alloc(size);
+#ifdef ARENA_TRACK
+  track_add(ptr, size, __builtin_return_address(0));
+#endif
+  return ptr;
+}
 
-  block_t *block = (block_t *)ptr;
-  arena_t *arena = get_block_arena(block);
+// 分配 count 个同样大小的块，只查找一次描述符，每个 arena 连续取块
+void kmalloc_batch(size_t size, void **ptrs, u32 count)
+{
+  arena_descriptor_t *desc = get_descriptor(size);
+  u32 i = 0;
+  while (i < count)
+  {
+    if (!desc)
+    {
+      ptrs[i++] = large_alloc(large_pages(size));
+      continue;
+    }
+
+    arena_t *arena = get_free_arena(desc);
+    while (arena->count && i < count)
+    {
+      ptrs[i++] = arena_take(arena);
+      desc->requested += size;
+      desc->allocated += desc->block_size;
+    }
+    arena_drained(arena);
+  }
+
+#ifdef ARENA_TRACK
+  for (size_t j = 0; j < count; j++)
+  {
+    track_add(ptrs[j], size, __builtin_return_address(0));
+  }
+#endif
+}
+
+// 调试时检查块是否属于 arena，以及是否重复释放
+static void arena_check(arena_t *arena, block_t *block)
+{
+#ifdef ARENA_DEBUG
+  u32 offset = (u32)block - (u32)arena->base;
+  assert(offset % arena->desc->block_size == 0);
+  assert(offset / arena->desc->block_size < arena->desc->total_block - arena->unused);
+  assert(!list_search(&arena->free_list, block));
+  assert(list_size(&arena->free_list) + arena->unused == arena->count);
+#endif
+}
 
+static arena_t *get_ptr_arena(void *ptr)
+{
+  assert(ptr);
+  arena_t *arena = get_block_arena((block_t *)ptr);
   assert(arena->large == 1 || arena->large == 0);
   assert(arena->magic == ONIX_MAGIC);
+  return arena;
+}
+
+static void large_free(arena_t *arena)
+{
+  stat_free(NULL, arena->count);
+  free_kpage((u32)arena, arena->count);
+}
+
+// 把同一个 arena 中的 count 个块放回空闲链表
+static void arena_put(arena_t *arena, void **ptrs, u32 count)
+{
+  arena_descriptor_t *desc = arena->desc;
+  bool full = !arena->count;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    block_t *block = (block_t *)ptrs[i];
+    arena_check(arena, block);
+    list_insert_after(&arena->free_list.head, block);
+    arena->count++;
+    stat_free(desc, 1);
+  }
+
+  // 之前是满的，放回 partial 链表
+  if (full)
+  {
+    list_remove(&arena->node);
+    list_insert_after(&desc->partial.head, &arena->node);
+  }
+
+  if (arena->count != desc->total_block)
+  {
+    return;
+  }
+
+  // 所有块都空闲了，缓存少量空 arena，其余释放
+  list_remove(&arena->node);
+  if (desc->empty_count < arena_empty_keep)
+  {
+    list_insert_after(&desc->empty.head, &arena->node);
+    desc->empty_count++;
+  }
+  else
+  {
+    arena_destroy(arena);
+  }
+}
+
+void kfree(void *ptr)
+{
+  arena_t *arena = get_ptr_arena(ptr);
+
+#ifdef ARENA_TRACK
+  track_del(ptr);
+#endif
 
   if (arena->large)
   {
-    free_kpage((u32)arena, arena->count);
+    large_free(arena);
     return;
   }
+  arena_put(arena, &ptr, 1);
+}
 
-  list_push(&arena->desc->free_list, block);
-  arena->count++;
+// 释放 count 个块，属于同一个 arena 的相邻块一起放回
+void kfree_batch(void **ptrs, u32 count)
+{
+  u32 i = 0;
+  while (i < count)
+  {
+    arena_t *arena = get_ptr_arena(ptrs[i]);
+#ifdef ARENA_TRACK
+    track_del(ptrs[i]);
+#endif
+    if (arena->large)
+    {
+      large_free(arena);
+      i++;
+      continue;
+    }
+
+    u32 j = i + 1;
+    while (j < count && get_block_arena(ptrs[j]) == arena)
+    {
+#ifdef ARENA_TRACK
+      track_del(ptrs[j]);
+#endif
+      j++;
+    }
+    arena_put(arena, ptrs + i, j - i);
+    i = j;
+  }
+}
 
-  if (arena->count == arena->desc->total_block)
+// 调整内存大小，块或大块内存的页能放下时原地调整
+void *krealloc(void *ptr, size_t size)
+{
+  if (!ptr)
   {
-    for (size_t i = 0; i < arena->desc->total_block; i++)
+    return kmalloc(size);
+  }
+  if (!size)
+  {
+    kfree(ptr);
+    return NULL;
+  }
+
+  arena_t *arena = get_ptr_arena(ptr);
+  u32 capacity;
+  if (arena->large)
+  {
+    capacity = arena->count * PAGE_SIZE - sizeof(arena_t);
+    u32 count = large_pages(size);
+    // 大块内存放不下时，尝试占用后面相邻的空闲页
+    if (size > capacity && grow_kpage((u32)arena, arena->count, count))
     {
-      block = get_arena_block(arena, i);
-      assert(list_search(&arena->desc->free_list, block));
-      list_remove(block);
-      assert(!list_search(&arena->desc->free_list, block));
+      set_arena_pages(arena, (void *)((u32)arena + arena->count * PAGE_SIZE),
+                      count - arena->count);
+#ifdef ARENA_STAT
+      large_stat.live += count - arena->count;
+      if (large_stat.live > large_stat.peak)
+        large_stat.peak = large_stat.live;
+#endif
+      arena->count = count;
+      capacity = count * PAGE_SIZE - sizeof(arena_t);
     }
-    free_kpage((u32)arena, 1);
   }
+  else
+  {
+    capacity = arena->desc->block_size;
+  }
+
+  if (size <= capacity)
+  {
+#ifdef ARENA_TRACK
+    track_del(ptr);
+    track_add(ptr, size, __builtin_return_address(0));
+#endif
+    return ptr;
+  }
+
+  void *addr = arena_alloc(size);
+#ifdef ARENA_TRACK
+  track_add(addr, size, __builtin_return_address(0));
+#endif
+  memcpy(addr, ptr, capacity);
+  kfree(ptr);
+  return addr;
+}
+
+// 释放所有缓存的空 arena，返回释放的页数
+// 从大到小回收，大块 arena 的头释放后可能产生新的小块空 arena
+u32 arena_shrink()
+{
+  u32 pages = 0;
+  for (int i = DESC_COUNT - 1; i >= 0; i--)
+  {
+    arena_descriptor_t *desc = &descriptors[i];
+    while (!list_empty(&desc->empty))
+    {
+      arena_t *arena = element_entry(arena_t, node, list_pop(&desc->empty));
+      desc->empty_count--;
+      pages += desc->pages;
+      arena_destroy(arena);
+    }
+  }
+  if (pages)
+  {
+    LOGK("arena shrink %d pages\n", pages);
+  }
+  return pages;
+}
+
+// 打印 kmalloc 的使用情况
+// slack 为每个 arena 放不下块的字节数，waste 为累计分配中块大小超出请求的字节数
+void arena_stat()
+{
+  printk("class  pages blocks slack empty requested waste\n");
+  for (size_t i = 0; i < DESC_COUNT; i++)
+  {
+    arena_descriptor_t *desc = &descriptors[i];
+    u32 slack = desc->pages * PAGE_SIZE - desc->total_block * desc->block_size;
+    printk("%6d %5d %6d %5d %5d %9d %d\n",
+           desc->block_size, desc->pages, desc->total_block, slack, desc->empty_count,
+           desc->requested, desc->allocated - desc->requested);
+  }
+#ifdef ARENA_STAT
+  printk("class  allocs frees live peak arenas peak\n");
+  for (size_t i = 0; i < DESC_COUNT; i++)
+  {
+    arena_class_stat_t *stat = &descriptors[i].stat;
+    printk("%6d %6d %5d %4d %4d %6d %d\n",
+           descriptors[i].block_size, stat->allocs, stat->frees,
+           stat->live, stat->peak, stat->arenas, stat->arenas_peak);
+  }
+  arena_class_stat_t *stat = &large_stat;
+  printk(" large %6d %5d %4d %4d pages\n",
+         stat->allocs, stat->frees, stat->live, stat->peak);
+#endif
+#ifdef ARENA_TRACK
+  arena_track_dump();
+#endif
+}
+
+// 所有 arena 中使用中的块数，用来检查测试前后没有泄漏
+// 先释放缓存的空 arena，它们的头也占用块
+static u32 arena_inuse()
+{
+  arena_shrink();
+  u32 count = 0;
+  for (size_t i = 0; i < DESC_COUNT; i++)
+  {
+    arena_descriptor_t *desc = &descriptors[i];
+    list_t *lists[] = {&desc->partial, &desc->full};
+    for (size_t j = 0; j < 2; j++)
+    {
+      for (list_node_t *ptr = lists[j]->head.next; ptr != &lists[j]->tail; ptr = ptr->next)
+      {
+        arena_t *arena = element_entry(arena_t, node, ptr);
+        count += desc->total_block - arena->count;
+      }
+    }
+  }
+  return count;
+}
+
+static void test_fill(void *ptr, u32 size, u8 seed)
+{
+  u8 *buf = (u8 *)ptr;
+  for (size_t i = 0; i < size; i++)
+  {
+    buf[i] = (u8)(seed + i);
+  }
+}
+
+static void test_check(void *ptr, u32 size, u8 seed)
+{
+  u8 *buf = (u8 *)ptr;
+  for (size_t i = 0; i < size; i++)
+  {
+    assert(buf[i] == (u8)(seed + i));
+  }
+}
+
+// 检查 ptr 能放下 size 字节，大块内存的每一页都能找到 arena
+static void test_capacity(void *ptr, u32 size)
+{
+  arena_t *arena = get_ptr_arena(ptr);
+  if (!arena->large)
+  {
+    assert(arena->desc->block_size >= size);
+    assert(get_descriptor(size) == arena->desc);
+    return;
+  }
+  assert(!get_descriptor(size));
+  assert(arena->count * PAGE_SIZE - sizeof(arena_t) >= size);
+  for (size_t i = 0; i < arena->count; i++)
+  {
+    assert(get_block_arena((block_t *)((u32)arena + i * PAGE_SIZE)) == arena);
+  }
+}
+
+#define ARENA_TEST_COUNT 40
+
+void arena_test()
+{
+  u32 inuse = arena_inuse();
+
+  // NULL 相当于 kmalloc，大小为 0 相当于 kfree
+  void *ptr = krealloc(NULL, 100);
+  test_capacity(ptr, 100);
+  test_fill(ptr, 100, 1);
+  assert(krealloc(ptr, 0) == NULL);
+  assert(arena_inuse() == inuse);
+
+  // 块能放下时原地缩小和增长
+  ptr = kmalloc(100);
+  test_fill(ptr, 100, 2);
+  assert(krealloc(ptr, 10) == ptr);
+  assert(krealloc(ptr, 128) == ptr);
+  test_check(ptr, 100, 2);
+
+  // 跨过每一级的边界，内容保持不变
+  u32 size = 128;
+  for (size_t i = 0; i < DESC_COUNT; i++)
+  {
+    u32 next = descriptors[i].block_size + 1;
+    if (next <= size)
+      continue;
+    test_fill(ptr, size, i);
+    ptr = krealloc(ptr, next);
+    test_capacity(ptr, next);
+    test_check(ptr, size, i);
+    size = next;
+  }
+
+  // 已经是大块内存，缩小原地进行
+  test_fill(ptr, size, 3);
+  assert(krealloc(ptr, 16) == ptr);
+  test_check(ptr, size, 3);
+
+  // 大块内存增长，后面的页空闲时原地扩展，否则复制
+  u32 grow = size + 3 * PAGE_SIZE;
+  ptr = krealloc(ptr, grow);
+  test_capacity(ptr, grow);
+  test_check(ptr, size, 3);
+  test_fill(ptr, grow, 4);
+  kfree(ptr);
+  assert(arena_inuse() == inuse);
+
+  // 批量分配每一级边界附近的大小，交错释放
+  static void *ptrs[ARENA_TEST_COUNT];
+  static void *order[ARENA_TEST_COUNT];
+  u32 sizes[] = {0, 16, 17, 1024, 1025, 1536, 8192, 8193};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(u32); s++)
+  {
+    size = sizes[s];
+    kmalloc_batch(size, ptrs, ARENA_TEST_COUNT);
+    for (size_t i = 0; i < ARENA_TEST_COUNT; i++)
+    {
+      test_capacity(ptrs[i], size);
+      test_fill(ptrs[i], size, i);
+    }
+    for (size_t i = 0; i < ARENA_TEST_COUNT; i++)
+    {
+      test_check(ptrs[i], size, i);
+    }
+
+    // 奇数位置和偶数位置分开，相邻的块属于不同的 arena
+    for (size_t i = 0; i < ARENA_TEST_COUNT; i++)
+    {
+      u32 half = ARENA_TEST_COUNT / 2;
+      order[i] = i < half ? ptrs[i * 2] : ptrs[(i - half) * 2 + 1];
+    }
+    kfree_batch(order, ARENA_TEST_COUNT);
+    assert(arena_inuse() == inuse);
+  }
+  LOGK("arena test ok\n");
 }
@@ -3,6 +3,8 @@
 #include <onix/assert.h>
 #include <onix/debug.h>
 #include <onix/task.h>
+#include <onix/stdlib.h>
+#include <onix/timer.h>
 
 #define PIT_CHAN0_REG 0X40
 #define PIT_CHAN2_REG 0X42
@@ -17,23 +19,126 @@
 u32 volatile jiffies = 0;
 u32 jiffy = JIFFY;
 
-extern void task_wakeup();
+// 单次模式计数器最大 0xffff，最多能等待的时钟周期数
+#define TICKLESS_MAX_TICKS (0xffff / CLOCK_COUNTER)
+
+static bool tickless;      // 空闲时定时器处于单次模式
+static u32 tickless_first; // 进入单次模式时距离下一个时钟周期的计数
+static u32 tickless_total; // 单次模式的计数，到期时正好是一个时钟周期的边界
+static u32 tickless_phase; // 重新开始周期模式时丢掉的不满一个周期的计数
+
+void pit_init();
+
+static void pit_oneshot(u32 count)
+{
+    outb(PIT_CTRL_REG, 0b00110000);
+    outb(PIT_CHAN0_REG, count & 0xff);
+    outb(PIT_CHAN0_REG, (count >> 8) & 0xff);
+}
+
+// 读取计数器 0 的当前值
+static u32 pit_count()
+{
+    outb(PIT_CTRL_REG, 0b00000000);
+    u32 count = inb(PIT_CHAN0_REG);
+    count |= inb(PIT_CHAN0_REG) << 8;
+    return count;
+}
+
+// 退出单次模式，恢复周期模式
+// 返回进入单次模式以来经过的时钟周期边界数，已经到期时不包括到期的那个边界，
+// 它由到期的时钟中断自己计数
+static u32 tickless_stop()
+{
+    u32 count = pit_count();
+    u32 passed;
+    if (count > tickless_total)
+    {
+        // 已经到期，计数器回绕之后继续递减
+        passed = tickless_total + 0x10000 - count;
+    }
+    else
+    {
+        passed = tickless_total - count;
+    }
+    bool expired = passed >= tickless_total;
+
+    u32 ticks;
+    u32 frac; // 距离上一个边界的计数
+    if (passed < tickless_first)
+    {
+        ticks = 0;
+        frac = CLOCK_COUNTER - tickless_first + passed;
+    }
+    else
+    {
+        ticks = 1 + (passed - tickless_first) / CLOCK_COUNTER;
+        frac = (passed - tickless_first) % CLOCK_COUNTER;
+    }
+
+    tickless = false;
+    pit_init();
+
+    // 周期从现在重新开始，之后的边界都推迟了 frac，累计满一个周期补一次
+    tickless_phase += frac;
+    if (tickless_phase >= CLOCK_COUNTER)
+    {
+        tickless_phase -= CLOCK_COUNTER;
+        ticks++;
+    }
+    return expired ? ticks - 1 : ticks;
+}
 
 void clock_handler(int vector)
 {
     assert(vector == 0x20);
     send_eoi(vector);
-    task_wakeup();
+    if (tickless)
+    {
+        // 单次模式到期，补上跳过的时钟周期，恢复周期模式
+        // 也可能是进入单次模式之前就挂起的周期中断，按普通的时钟周期处理
+        jiffies += tickless_stop();
+    }
+    timer_run();
     jiffies++;
     // DEBUGK("clock jiffies %d ...\n", jiffies);
     task_t *task = running_task();
     assert(task->magic == ONIX_MAGIC);
     task->jiffies = jiffies;
-    task->ticks--;
-    if (!task->ticks)
-    {
-        schedule();
-    }
+    task_tick(task);
+}
+
+// 只有空闲任务可以执行时调用
+// 定时器设置为单次模式，在最近的定时器到期的时钟周期边界再中断
+void clock_idle_enter()
+{
+    assert(!get_interrupt_state());
+    // 与周期模式一致，jiffies 等于定时器到期时间的那次中断处理
+    u32 ticks = MIN(timer_next(TICKLESS_MAX_TICKS) + 1, TICKLESS_MAX_TICKS);
+    if (ticks <= 1)
+        return;
+
+    tickless = true;
+    tickless_first = pit_count();
+    tickless_total = tickless_first + (ticks - 1) * CLOCK_COUNTER;
+    pit_oneshot(tickless_total);
+}
+
+// 被其他中断唤醒后调用，补上已经过去的时钟周期，处理其中到期的定时器，恢复周期模式
+void clock_idle_exit()
+{
+    assert(!get_interrupt_state());
+    if (!tickless)
+        return;
+
+    // 已经到期时中断还没有处理，处理时会再加一
+    u32 ticks = tickless_stop();
+    if (!ticks)
+        return;
+
+    jiffies += ticks - 1;
+    timer_run();
+    jiffies++;
 }
 
 void pit_init()
@@ -45,6 +150,7 @@ void pit_init()
 
 void clock_init()
 {
+    timer_init();
     pit_init();
     set_interrupt_handler(IRQ_CLOCK, clock_handler);
     set_interrupt_mask(IRQ_CLOCK, true);
@@ -4,6 +4,7 @@
 #include <onix/syscall.h>
 #include <onix/task.h>
 #include <onix/console.h>
+#include <onix/arena.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
@@ -45,6 +46,7 @@ int32 sys_brk(void *addr);
 pid_t sys_getpid();
 pid_t sys_getppid();
 pid_t task_fork();
+pid_t task_spawn(target_t start);
 
 void syscall_init()
 {
@@ -55,10 +57,13 @@ void syscall_init()
     syscall_table[SYS_NR_TEST]  = sys_test;
     syscall_table[SYS_NR_EXIT] = task_exit;
     syscall_table[SYS_NR_FORK] = task_fork;
+    syscall_table[SYS_NR_SPAWN] = task_spawn;
+    syscall_table[SYS_NR_WAITPID] = task_waitpid;
     syscall_table[SYS_NR_WRITE] = sys_write;
     syscall_table[SYS_NR_SLEEP]  = task_sleep;
     syscall_table[SYS_NR_GETPID] = sys_getpid;
     syscall_table[SYS_NR_GETPPID] = sys_getppid;
     syscall_table[SYS_NR_BRK]  = sys_brk;
     syscall_table[SYS_NR_YIELD] = task_yield;
+    syscall_table[SYS_NR_KMSTAT] = arena_stat;
 }
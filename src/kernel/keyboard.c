@@ -6,6 +6,9 @@
 #include <onix/mutex.h>
 #include <onix/task.h>
 
+extern u32 volatile jiffies;
+extern u32 jiffy;
+
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
 #define KEYBOARD_DATA_PORT 0x60
@@ -383,10 +386,12 @@ void keyboard_handler(int vector)
 
     // LOGK("keydown %c \n", ch);
     fifo_put(&fifo, ch);
-    if (waiter != NULL)
+    // 读者可能已经超时唤醒，在就绪队列中等待执行，这时不能再唤醒
+    if (waiter != NULL && waiter->state == TASK_WAITING)
     {
         task_unblock(waiter);
         waiter = NULL;
+        task_preempt();
     }
 }
 
@@ -407,6 +412,34 @@ u32 keyboard_read(char *buf, u32 count)
     return count;
 }
 
+// 最多等待 ms 毫秒，返回读到的字符数
+u32 keyboard_read_timeout(char *buf, u32 count, u32 ms)
+{
+    lock_acquire(&lock);
+    u32 ticks = ms / jiffy;
+    u32 deadline = jiffies + (ticks > 0 ? ticks : 1);
+    int nr = 0;
+    while (nr < count)
+    {
+        while (fifo_empty(&fifo))
+        {
+            int remain = deadline - jiffies;
+            if (remain <= 0)
+            {
+                goto rollback;
+            }
+            waiter = running_task();
+            task_block_timeout(waiter, NULL, TASK_WAITING, remain);
+            // 超时唤醒时中断处理程序没有清除，在重新阻塞之前清除
+            waiter = NULL;
+        }
+        buf[nr++] = fifo_get(&fifo);
+    }
+rollback:
+    lock_release(&lock);
+    return nr;
+}
+
 void keyboard_init()
 {
     numlock_state = false;
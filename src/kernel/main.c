@@ -19,6 +19,8 @@ extern void keyboard_init();
 extern void tss_init();
 extern void task_init();
 extern void arena_init();
+extern void arena_test();
+extern void timer_test();
 
 void intr_test()
 {
@@ -36,8 +38,10 @@ void kernel_init()
     memory_map_init();
     mapping_init();
     arena_init();
+    arena_test();
     interrupt_init();
     clock_init();
+    // timer_test();
     keyboard_init();
     // time_init();
     // rtc_init();
@@ -7,6 +7,9 @@
 #include <onix/bitmap.h>
 #include <onix/multiboot2.h>
 #include <onix/task.h>
+#include <onix/interrupt.h>
+#include <onix/time.h>
+#include <onix/arena.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
@@ -21,10 +24,11 @@
 
 #define PDE_MASK 0xFFC00000
 
+// 内核第一个 4M 的页表，其余内核内存使用 4M 大页
 static u32 KERNEL_PAGE_TABLE[] = {
     0x2000,
-    0x3000,
 };
+#define KMAP_PAGE_TABLE 0x3000 // 临时映射窗口的页表
 #define KERNEL_MAP_BITS 0x4000
 
 bitmap_t kernel_map;
@@ -109,21 +113,149 @@ void memory_init(u32 magic, u32 addr)
 }
 
 static u32 start_page = 0;
-static u8 *memory_map;
+static page_t *page_map; // 物理页描述符数组
 static u32 memory_map_pages;
 
+#define ASSERT_PFN(idx) assert((idx) >= start_page && (idx) < total_pages)
+
+// 伙伴系统最大阶数，最大块为 2^(BUDDY_ORDERS - 1) 页，即 4M
+#define BUDDY_ORDERS 11
+
+static list_t free_area[BUDDY_ORDERS]; // 每一阶的空闲链表
+
+// 预先清零的页池大小，由空闲进程填充
+#define ZERO_POOL_PAGES 32
+#define KZERO_POOL_PAGES 8
+
+static list_t zero_pool; // 清零的物理页，仍计入空闲页数
+static u32 zero_pool_count;
+static u32 kzero_pool[KZERO_POOL_PAGES]; // 清零的内核页
+static u32 kzero_pool_count;
+
+u32 zero_pool_hits;   // 从池中取到清零页的次数
+u32 zero_pool_misses; // 池为空，同步清零的次数
+
+// 获取物理页索引对应的描述符
+page_t *pfn_to_page(u32 idx)
+{
+  assert(idx < total_pages);
+  return &page_map[idx];
+}
+
+// 获取描述符对应的物理页索引
+u32 page_to_pfn(page_t *page)
+{
+  return page - page_map;
+}
+
+// 判断 idx 是否为阶数为 order 的空闲块
+static bool buddy_free_block(u32 idx, u32 order)
+{
+  if (idx < start_page || idx + (1 << order) > total_pages)
+  {
+    return false;
+  }
+  page_t *page = &page_map[idx];
+  return (page->flags & PG_BUDDY) && page->order == order;
+}
+
+// 将 idx 开始的块加入空闲链表，list_push 会线性查找，这里直接插入
+static void buddy_insert(u32 idx, u32 order)
+{
+  page_t *page = &page_map[idx];
+  assert(page->count == 0);
+  page->order = order;
+  page->flags |= PG_BUDDY;
+  list_insert_after(&free_area[order].head, &page->node);
+}
+
+// 将空闲块从空闲链表中摘下
+static void buddy_remove(page_t *page)
+{
+  assert(page->flags & PG_BUDDY);
+  list_remove(&page->node);
+  page->flags &= ~PG_BUDDY;
+}
+
+// 分配 2^order 个连续的物理页，返回首页索引，没有足够的内存返回 EOF
+static u32 buddy_alloc(u32 order)
+{
+  assert(order < BUDDY_ORDERS);
+
+  u32 current = order;
+  while (current < BUDDY_ORDERS && list_empty(&free_area[current]))
+  {
+    current++;
+  }
+  if (current == BUDDY_ORDERS)
+  {
+    return EOF;
+  }
+
+  page_t *page = element_entry(page_t, node, free_area[current].head.next);
+  buddy_remove(page);
+  u32 idx = page_to_pfn(page);
+
+  // 将多余的部分拆分成伙伴，放回低阶空闲链表
+  while (current > order)
+  {
+    current--;
+    buddy_insert(idx + (1 << current), current);
+  }
+  return idx;
+}
+
+// 释放 idx 开始的 2^order 个物理页，并与空闲的伙伴合并
+static void buddy_free(u32 idx, u32 order)
+{
+  assert((idx & ((1 << order) - 1)) == 0);
+  while (order < BUDDY_ORDERS - 1)
+  {
+    u32 buddy = idx ^ (1 << order);
+    if (!buddy_free_block(buddy, order))
+    {
+      break;
+    }
+    buddy_remove(&page_map[buddy]);
+    idx &= ~(1 << order);
+    order++;
+  }
+  buddy_insert(idx, order);
+}
+
 void memory_map_init()
 {
-  memory_map = (u8 *)memory_base;
-  // 计算物理内存数组需要占用的页数
-  memory_map_pages = div_round_up(total_pages, PAGE_SIZE);
+  page_map = (page_t *)memory_base;
+  // 计算物理页描述符数组需要占用的页数
+  memory_map_pages = div_round_up(total_pages * sizeof(page_t), PAGE_SIZE);
   LOGK("memory map page count %d\n", memory_map_pages);
-  free_pages -= memory_map_pages;
-  memset((void *)memory_map, 0, memory_map_pages * PAGE_SIZE);
+  memset((void *)page_map, 0, memory_map_pages * PAGE_SIZE);
   start_page = IDX(MEMORY_BASE) + memory_map_pages;
   for (size_t i = 0; i < start_page; i++)
   {
-    memory_map[i] = 1;
+    page_map[i].count = 1;
+    page_map[i].flags = PG_RESERVED;
+  }
+
+  // 内核内存由 kernel_map 管理，伙伴系统只管理内核之外的物理页
+  for (size_t i = 0; i < BUDDY_ORDERS; i++)
+  {
+    list_init(&free_area[i]);
+  }
+  list_init(&zero_pool);
+  u32 idx = IDX(KERNEL_MEMORY_SIZE);
+  free_pages = 0;
+  while (idx < total_pages)
+  {
+    // 每次放入对齐且不越界的最大块
+    u32 order = BUDDY_ORDERS - 1;
+    while ((idx & ((1 << order) - 1)) || idx + (1 << order) > total_pages)
+    {
+      order--;
+    }
+    buddy_insert(idx, order);
+    idx += 1 << order;
+    free_pages += 1 << order;
   }
   LOGK("total pages %d free pages %d\n", total_pages, free_pages);
 
@@ -132,21 +264,46 @@ void memory_map_init()
   bitmap_scan(&kernel_map, memory_map_pages);
 }
 
+// 从清零页池中取出一页
+static u32 zero_pool_pop()
+{
+  page_t *page = element_entry(page_t, node, list_pop(&zero_pool));
+  assert(page->flags & PG_ZEROED);
+  page->flags &= ~PG_ZEROED;
+  zero_pool_count--;
+  return page_to_pfn(page);
+}
+
+// 初始化分配出去的物理页
+static u32 page_alloced(u32 idx)
+{
+  assert(idx >= IDX(KERNEL_MEMORY_SIZE) && idx < total_pages);
+  page_t *page = &page_map[idx];
+  assert(page->count == 0);
+  page->count = 1;
+  page->flags = 0;
+  page->owner = NULL;
+  page->vaddr = 0;
+  free_pages--;
+  assert(free_pages >= 0);
+  u32 addr = PAGE(idx);
+  LOGK("get page 0x%p\n", addr);
+  return addr;
+}
+
 static u32 get_page()
 {
-  for (size_t i = start_page; i < total_pages; i++)
+  u32 idx = buddy_alloc(0);
+  if (idx == EOF)
   {
-    if (!memory_map[i])
+    // 伙伴系统用完了，清零页池中的页也可以用
+    if (list_empty(&zero_pool))
     {
-      memory_map[i] = 1;
-      free_pages--;
-      assert(free_pages >= 0);
-      u32 page = PAGE(i);
-      LOGK("get page 0x%p\n", page);
-      return page;
+      panic("OOM");
     }
+    idx = zero_pool_pop();
   }
-  panic("OOM");
+  return page_alloced(idx);
 }
 
 static void put_page(u32 addr)
@@ -154,12 +311,14 @@ static void put_page(u32 addr)
   ASSERT_PAGE(addr);
   u32 idx = IDX(addr);
 
-  assert(idx >= start_page && idx < total_pages);
-  assert(memory_map[idx] >= 1);
-  memory_map[idx]--;
-  if (!memory_map[idx])
+  ASSERT_PFN(idx);
+  page_t *page = &page_map[idx];
+  assert(page->count >= 1);
+  page->count--;
+  if (!page->count)
   {
     free_pages++;
+    buddy_free(idx, 0);
   }
   assert(free_pages > 0 && free_pages < total_pages);
   LOGK("put pages 0x%p\n", addr);
@@ -196,6 +355,21 @@ void set_cr3(u32 pde)
                : "a"(pde));
 }
 
+#define CR4_PSE (1 << 4) // 允许 4M 大页
+#define CR4_PGE (1 << 7) // 允许全局页，切换 cr3 时不刷新
+
+static u32 get_cr4()
+{
+  asm volatile("movl %cr4, %eax\n");
+}
+
+static void set_cr4(u32 cr4)
+{
+  asm volatile("movl %%eax, %%cr4\n"
+               :
+               : "a"(cr4));
+}
+
 // 将 cr0 寄存器最高位 PE 置为 1，启用分页
 static inline void enable_page()
 {
@@ -217,32 +391,64 @@ static void entry_init(page_entry_t *entry, u32 index)
   entry->index = index;
 }
 
+// 全零页，读未访问过的堆栈时只读映射到这里
+static u32 zero_page;
+
 void mapping_init()
 {
   page_entry_t *pde = (page_entry_t *)KERNEL_PAGE_DIR;
   memset(pde, 0, PAGE_SIZE);
+
+  // 第一个 4M 使用页表映射，保留 0 页不映射
+  page_entry_t *pte = (page_entry_t *)KERNEL_PAGE_TABLE[0];
+  memset(pte, 0, PAGE_SIZE);
+  entry_init(&pde[0], IDX((u32)pte));
   idx_t index = 0;
-  for (idx_t didx = 0; didx < sizeof(KERNEL_PAGE_TABLE) / 4; didx++)
+  for (idx_t tidx = 0; tidx < 1024; tidx++, index++)
+  {
+    if (index == 0)
+    {
+      continue;
+    }
+    page_entry_t *tentry = &pte[tidx];
+    entry_init(tentry, index);
+    tentry->global = true;
+    page_map[index].count = 1;
+    page_map[index].flags = PG_RESERVED;
+  }
+
+  // 剩下的内核内存使用 4M 大页映射
+  for (idx_t didx = 1; didx < DIDX(KERNEL_MEMORY_SIZE); didx++)
   {
-    page_entry_t *pte = (page_entry_t *)KERNEL_PAGE_TABLE[didx];
-    memset(pte, 0, PAGE_SIZE);
     page_entry_t *dentry = &pde[didx];
-    entry_init(dentry, IDX((u32)pte));
+    entry_init(dentry, index);
+    dentry->pat = true; // 页目录项中该位表示 4M 大页
+    dentry->global = true;
     for (idx_t tidx = 0; tidx < 1024; tidx++, index++)
     {
-      if (index == 0)
-      {
-        continue;
-      }
-      page_entry_t *tentry = &pte[tidx];
-      entry_init(tentry, index);
-      memory_map[index] = 1;
+      page_map[index].count = 1;
+      page_map[index].flags = PG_RESERVED;
     }
   }
+
+  // 临时映射窗口，页目录项会被复制到每个进程
+  pte = (page_entry_t *)KMAP_PAGE_TABLE;
+  memset(pte, 0, PAGE_SIZE);
+  entry_init(&pde[DIDX(KMAP_BASE)], IDX((u32)pte));
+  pde[DIDX(KMAP_BASE)].user = false;
+
   page_entry_t *entry = &pde[1023];
   entry_init(entry, IDX(KERNEL_PAGE_DIR));
   set_cr3((u32)pde);
+  set_cr4(get_cr4() | CR4_PSE);
   enable_page();
+  // 开启分页之后再启用全局页，内核映射在切换进程时保留在快表中
+  set_cr4(get_cr4() | CR4_PGE);
+
+  // 零页由内核持有一个引用，永远不会被释放
+  zero_page = alloc_kpage(1);
+  memset((void *)zero_page, 0, PAGE_SIZE);
+  pfn_to_page(IDX(zero_page))->flags |= PG_ZERO;
 }
 
 static page_entry_t *get_pde()
@@ -250,6 +456,49 @@ static page_entry_t *get_pde()
   return (page_entry_t *)(0xfffff000);
 }
 
+static u32 copy_page(void *page);
+static u32 get_zero_page();
+
+// fork 之后页表被共享，页目录项只读；写之前为当前进程拆分出私有的页表
+static void unshare_pte(page_entry_t *dentry, u32 didx)
+{
+  assert(dentry->present && !dentry->write);
+  page_t *table = pfn_to_page(dentry->index);
+  assert(table->count > 0);
+
+  // 还被其他进程共享，表中的页都改为只读，增加引用，再为当前进程复制一份页表
+  if (table->count > 1)
+  {
+    page_entry_t *pte = (page_entry_t *)(PDE_MASK | PAGE(didx));
+    for (size_t tidx = 0; tidx < 1024; tidx++)
+    {
+      page_entry_t *entry = &pte[tidx];
+      if (!entry->present)
+      {
+        continue;
+      }
+      page_t *page = pfn_to_page(entry->index);
+      assert(page->count > 0);
+      entry->write = false;
+      page->count++;
+    }
+    u32 paddr = copy_page(pte);
+    table->count--;
+    dentry->index = IDX(paddr);
+    LOGK("UNSHARE page table 0x%p\n", PAGE(didx << 10));
+  }
+  // 页表只有当前进程使用，原来就只剩当前进程或者是刚复制的，直接恢复可写
+  dentry->write = true;
+
+  // 页目录项改变，刷新这 4M 的映射和页表本身的映射
+  tlb_batch_t batch;
+  tlb_batch_init(&batch);
+  tlb_batch_add_range(&batch, PAGE(didx << 10), 1024);
+  tlb_batch_add(&batch, PDE_MASK | PAGE(didx));
+  tlb_batch_flush(&batch);
+}
+
+// 获取 vaddr 所在的页表，create 表示需要写页表，若不存在则创建，若被共享则拆分
 static page_entry_t *get_pte(u32 vaddr, bool create)
 {
   // vaddr = 0x1600000
@@ -268,11 +517,14 @@ static page_entry_t *get_pte(u32 vaddr, bool create)
   if (!entry->present)
   {
     LOGK("Get and create page table entry for 0x%p\n", vaddr);
-    // 为页表申请内存
-    u32 page = get_page();
+    // 为页表申请清零的内存
+    u32 page = get_zero_page();
     // 关联页表
     entry_init(entry, IDX(page));
-    memset(table, 0, PAGE_SIZE);
+  }
+  else if (create && !entry->write)
+  {
+    unshare_pte(entry, idx);
   }
   return table;
 }
@@ -285,6 +537,93 @@ static void flush_tlb(u32 vaddr)
                : "memory");
 }
 
+// 临时映射槽位的使用情况，置位表示被占用
+static u32 kmap_slots;
+
+// 将物理页 paddr 临时映射到内核空间，只能短时间使用
+void *kmap(u32 paddr)
+{
+  ASSERT_PAGE(paddr);
+  bool intr = interrupt_disable();
+
+  if (kmap_slots == 0xffffffff)
+  {
+    panic("no more kmap slots");
+  }
+  u32 slot = __builtin_ctz(~kmap_slots);
+  kmap_slots |= 1 << slot;
+
+  u32 vaddr = KMAP_BASE + PAGE(slot);
+  page_entry_t *entry = &((page_entry_t *)KMAP_PAGE_TABLE)[slot];
+  assert(!entry->present);
+  entry_init(entry, IDX(paddr));
+  entry->user = false;
+  // 槽位之前的映射在 kunmap 时已经刷新
+  set_interrupt_state(intr);
+  return (void *)vaddr;
+}
+
+// 去掉临时映射
+void kunmap(void *vaddr)
+{
+  u32 slot = IDX((u32)vaddr - KMAP_BASE);
+  assert(((u32)vaddr & 0xfff) == 0 && slot < KMAP_SLOTS);
+
+  bool intr = interrupt_disable();
+  page_entry_t *entry = &((page_entry_t *)KMAP_PAGE_TABLE)[slot];
+  assert(entry->present && (kmap_slots & (1 << slot)));
+  entry->present = false;
+  flush_tlb((u32)vaddr);
+  kmap_slots &= ~(1 << slot);
+  set_interrupt_state(intr);
+}
+
+void tlb_batch_init(tlb_batch_t *batch)
+{
+  batch->count = 0;
+}
+
+// 记录需要刷新的虚拟地址，超过批量大小之后只计数
+void tlb_batch_add(tlb_batch_t *batch, u32 vaddr)
+{
+  if (batch->count < TLB_BATCH_SIZE)
+  {
+    batch->vaddr[batch->count] = vaddr;
+  }
+  batch->count++;
+}
+
+// 记录从 vaddr 开始的 count 页
+void tlb_batch_add_range(tlb_batch_t *batch, u32 vaddr, u32 count)
+{
+  if (batch->count + count > TLB_BATCH_SIZE)
+  {
+    batch->count += count;
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    tlb_batch_add(batch, vaddr + i * PAGE_SIZE);
+  }
+}
+
+// 页数少时逐个 invlpg，否则重新加载 cr3，内核的全局页不受影响
+void tlb_batch_flush(tlb_batch_t *batch)
+{
+  if (batch->count > TLB_BATCH_SIZE)
+  {
+    set_cr3(get_cr3());
+  }
+  else
+  {
+    for (size_t i = 0; i < batch->count; i++)
+    {
+      flush_tlb(batch->vaddr[i]);
+    }
+  }
+  batch->count = 0;
+}
+
 void mapping_test()
 {
 
@@ -311,10 +650,52 @@ void mapping_test()
   BMB;
 }
 
+#define TLB_BENCH_PAGES 64
+#define TLB_BENCH_ROUNDS 64
+
+// 模拟进程切换：重新加载 cr3 之后访问内核工作集，返回平均周期数
+static u32 tlb_bench_round()
+{
+  u64 start = rdtsc();
+  for (size_t i = 0; i < TLB_BENCH_ROUNDS; i++)
+  {
+    set_cr3(get_cr3());
+    for (size_t j = 0; j < TLB_BENCH_PAGES; j++)
+    {
+      // 内核内存 1M 开始的页，包括页描述符数组和内核页
+      volatile u32 *ptr = (u32 *)(MEMORY_BASE + j * PAGE_SIZE * 16);
+      *ptr;
+    }
+  }
+  return (u32)((rdtsc() - start) / TLB_BENCH_ROUNDS);
+}
+
+// 比较内核映射是否为全局页时，切换 cr3 之后重新填充快表的开销
+void tlb_bench()
+{
+  bool intr = interrupt_disable();
+
+  u32 global = tlb_bench_round();
+
+  // 关闭 PGE 会刷新所有全局页，之后内核映射和普通映射一样在切换时刷新
+  set_cr4(get_cr4() & ~CR4_PGE);
+  u32 local = tlb_bench_round();
+  set_cr4(get_cr4() | CR4_PGE);
+
+  LOGK("cr3 switch with global kernel pages %d cycles, without %d cycles\n",
+       global, local);
+  set_interrupt_state(intr);
+}
+
 static u32 scan_page(bitmap_t *map, u32 count)
 {
   assert(count > 0);
   u32 index = bitmap_scan(map, count);
+  // 内核页不够时，先回收 kmalloc 缓存的空 arena
+  if (index == EOF && map == &kernel_map && arena_shrink())
+  {
+    index = bitmap_scan(map, count);
+  }
   if (index == EOF)
   {
     panic("Scan page fail");
@@ -331,11 +712,8 @@ static void reset_page(bitmap_t *map, u32 addr, u32 count)
 
   u32 index = IDX(addr);
 
-  for (size_t i = 0; i < count; i++)
-  {
-    assert(bitmap_test(map, index + i));
-    bitmap_set(map, index + i, 0);
-  }
+  assert(bitmap_test(map, index) && bitmap_test(map, index + count - 1));
+  bitmap_clear_range(map, index, count);
 }
 
 u32 alloc_kpage(u32 count)
@@ -354,6 +732,28 @@ void free_kpage(u32 vaddr, u32 count)
   LOGK("FREE  kernel pages 0x%p count %d\n", vaddr, count);
 }
 
+// 尝试把 vaddr 开始的 count 个内核页原地扩展到 new_count 个
+// 后面的页都空闲时才成功
+bool grow_kpage(u32 vaddr, u32 count, u32 new_count)
+{
+  ASSERT_PAGE(vaddr);
+  assert(new_count > count);
+
+  u32 index = IDX(vaddr) + count;
+  u32 end = IDX(vaddr) + new_count;
+  if ((end - kernel_map.offset) > kernel_map.length * 8)
+    return false;
+
+  for (u32 i = index; i < end; i++)
+  {
+    if (bitmap_test(&kernel_map, i))
+      return false;
+  }
+  bitmap_set_range(&kernel_map, index, end - index);
+  LOGK("GROW  kernel pages 0x%p count %d -> %d\n", vaddr, count, new_count);
+  return true;
+}
+
 void memory_alloc_test()
 {
   u32 *pages = (u32 *)(0x200000);
@@ -370,6 +770,84 @@ void memory_alloc_test()
   }
 }
 
+// 临时映射 paddr，将其清零
+static void zero_frame(u32 paddr)
+{
+  void *vaddr = kmap(paddr);
+  memset(vaddr, 0, PAGE_SIZE);
+  kunmap(vaddr);
+}
+
+// 获取一个清零的物理页
+static u32 get_zero_page()
+{
+  if (!list_empty(&zero_pool))
+  {
+    zero_pool_hits++;
+    return page_alloced(zero_pool_pop());
+  }
+  zero_pool_misses++;
+  u32 paddr = get_page();
+  zero_frame(paddr);
+  return paddr;
+}
+
+// 获取一个清零的内核页
+u32 alloc_zero_kpage()
+{
+  if (kzero_pool_count)
+  {
+    zero_pool_hits++;
+    return kzero_pool[--kzero_pool_count];
+  }
+  zero_pool_misses++;
+  u32 vaddr = alloc_kpage(1);
+  memset((void *)vaddr, 0, PAGE_SIZE);
+  return vaddr;
+}
+
+// 空闲时清零一页放入池中，池已满或内存不足时返回 false
+// 只有取页和入池时关中断，清零本身可以被打断
+bool zero_pool_refill()
+{
+  bool intr = interrupt_disable();
+
+  if (kzero_pool_count < KZERO_POOL_PAGES)
+  {
+    idx_t index = bitmap_scan(&kernel_map, 1);
+    set_interrupt_state(intr);
+    if (index == EOF)
+    {
+      return false;
+    }
+    memset((void *)PAGE(index), 0, PAGE_SIZE);
+
+    intr = interrupt_disable();
+    kzero_pool[kzero_pool_count++] = PAGE(index);
+    set_interrupt_state(intr);
+    return true;
+  }
+
+  u32 idx = EOF;
+  if (zero_pool_count < ZERO_POOL_PAGES)
+  {
+    idx = buddy_alloc(0);
+  }
+  set_interrupt_state(intr);
+  if (idx == EOF)
+  {
+    return false;
+  }
+  zero_frame(PAGE(idx));
+
+  intr = interrupt_disable();
+  page_map[idx].flags |= PG_ZEROED;
+  list_insert_after(&zero_pool.head, &page_map[idx].node);
+  zero_pool_count++;
+  set_interrupt_state(intr);
+  return true;
+}
+
 // 将 vaddr 映射物理内存
 void link_page(u32 vaddr)
 {
@@ -392,15 +870,19 @@ void link_page(u32 vaddr)
   assert(!bitmap_test(map, index));
   bitmap_set(map, index, true);
 
-  u32 paddr = get_page();
+  u32 paddr = get_zero_page();
   entry_init(entry, IDX(paddr));
   flush_tlb(vaddr);
 
+  page_t *page = pfn_to_page(IDX(paddr));
+  page->owner = task;
+  page->vaddr = vaddr;
+
   LOGK("LINK from 0x%p to 0x%p\n", vaddr, paddr);
 }
 
-// 去掉 vaddr 对应的物理内存映射
-void unlink_page(u32 vaddr)
+// 将 vaddr 只读映射到零页，写时由 page_fault 复制出私有的页
+static void link_zero_page(u32 vaddr)
 {
   ASSERT_PAGE(vaddr);
 
@@ -411,12 +893,44 @@ void unlink_page(u32 vaddr)
   bitmap_t *map = task->vmap;
   u32 index = IDX(vaddr);
 
-  if (!entry->present)
+  if (entry->present)
+  {
+    assert(bitmap_test(map, index));
+    return;
+  }
+
+  assert(!bitmap_test(map, index));
+  bitmap_set(map, index, true);
+
+  page_t *page = pfn_to_page(IDX(zero_page));
+  assert(page->count > 0);
+  page->count++;
+
+  entry_init(entry, IDX(zero_page));
+  entry->write = false;
+  flush_tlb(vaddr);
+
+  LOGK("LINK from 0x%p to zero page\n", vaddr);
+}
+
+// 去掉 vaddr 对应的物理内存映射
+static void unlink_page_batch(u32 vaddr, tlb_batch_t *batch)
+{
+  ASSERT_PAGE(vaddr);
+
+  task_t *task = running_task();
+  bitmap_t *map = task->vmap;
+  u32 index = IDX(vaddr);
+
+  // 没有映射的页不需要创建页表
+  if (!bitmap_test(map, index))
   {
-    assert(!bitmap_test(map, index));
     return;
   }
 
+  page_entry_t *pte = get_pte(vaddr, true);
+  page_entry_t *entry = &pte[TIDX(vaddr)];
+
   assert(entry->present && bitmap_test(map, index));
 
   entry->present = false;
@@ -426,16 +940,23 @@ void unlink_page(u32 vaddr)
 
   DEBUGK("UNLINK from 0x%p to 0x%p\n", vaddr, paddr);
   put_page(paddr);
-  flush_tlb(vaddr);
+  tlb_batch_add(batch, vaddr);
+}
+
+void unlink_page(u32 vaddr)
+{
+  tlb_batch_t batch;
+  tlb_batch_init(&batch);
+  unlink_page_batch(vaddr, &batch);
+  tlb_batch_flush(&batch);
 }
 
 static u32 copy_page(void *page)
 {
   u32 paddr = get_page();
-  page_entry_t *entry = get_pte(0, false);
-  entry_init(entry, IDX(paddr));
-  memcpy((void *)0, (void *)page, PAGE_SIZE);
-  entry->present = false;
+  void *vaddr = kmap(paddr);
+  memcpy(vaddr, page, PAGE_SIZE);
+  kunmap(vaddr);
   return paddr;
 }
 
@@ -448,29 +969,20 @@ page_entry_t *copy_pde()
   page_entry_t *entry = &pde[1023];
   entry_init(entry, IDX(pde));
 
-  page_entry_t *dentry;
-  for (size_t didx = 2; didx < 1023; didx++)
+  // 用户页表不复制，父子进程共享，并将页目录项置为只读，写时再拆分
+  page_entry_t *parent = get_pde();
+  for (size_t didx = 2; didx < DIDX(KMAP_BASE); didx++)
   {
-    dentry = &pde[didx];
+    page_entry_t *dentry = &pde[didx];
     if (!dentry->present)
     {
       continue;
     }
-    page_entry_t *pte = (page_entry_t *)(PDE_MASK | PAGE(didx));
-    for (size_t tidx = 0; tidx < 1024; tidx++)
-    {
-      entry = &pte[tidx];
-      if (!entry->present)
-      {
-        continue;
-      }
-      assert(memory_map[entry->index] > 0);
-      entry->write = false;
-      memory_map[entry->index]++;
-      assert(memory_map[entry->index] < 255);
-    }
-    u32 paddr = copy_page(pte);
-    dentry->index = IDX(paddr);
+    page_t *table = pfn_to_page(dentry->index);
+    assert(table->count > 0);
+    table->count++;
+    dentry->write = false;
+    parent[didx].write = false;
   }
   set_cr3(task->pde);
   return pde;
@@ -481,13 +993,23 @@ void free_pde()
   task_t *task = running_task();
   assert(task->uid != KERNEL_USER);
   page_entry_t *pde = get_pde();
-  for (size_t didx = 2; didx < 1023; didx++)
+  tlb_batch_t batch;
+  tlb_batch_init(&batch);
+  for (size_t didx = 2; didx < DIDX(KMAP_BASE); didx++)
   {
     page_entry_t *dentry = &pde[didx];
     if (!dentry->present)
     {
       continue;
     }
+    tlb_batch_add_range(&batch, PAGE(didx << 10), 1024);
+    // 页表还被其他进程共享，只减少页表的引用
+    if (pfn_to_page(dentry->index)->count > 1)
+    {
+      put_page(PAGE(dentry->index));
+      dentry->present = false;
+      continue;
+    }
     page_entry_t *pte = (page_entry_t *)(PDE_MASK | PAGE(didx));
     for (size_t tidx = 0; tidx < 1024; tidx++)
     {
@@ -496,11 +1018,14 @@ void free_pde()
       {
         continue;
       }
-      assert(memory_map[entry->index] > 0);
+      assert(pfn_to_page(entry->index)->count > 0);
       put_page(PAGE(entry->index));
     }
     put_page(PAGE(dentry->index));
+    dentry->present = false;
   }
+  // 用户映射已经全部去掉，一次刷新
+  tlb_batch_flush(&batch);
   free_kpage(task->pde, 1);
   LOGK("free pages %d\n", free_pages);
 }
@@ -520,10 +1045,13 @@ int32 sys_brk(void *addr)
 
     if (old_brk > brk)
     {
+        tlb_batch_t batch;
+        tlb_batch_init(&batch);
         for (u32 page = brk; page < old_brk; page += PAGE_SIZE)
         {
-            unlink_page(page);
+            unlink_page_batch(page, &batch);
         }
+        tlb_batch_flush(&batch);
     }
     
     else if (IDX(brk - old_brk) > free_pages)
@@ -550,6 +1078,109 @@ typedef struct page_error_code_t
     u16 reserved2;
 } _packed page_error_code_t;
 
+// 缺页时顺便映射同一窗口内的页数，为 1 时不预先映射
+u32 fault_around_pages = 8;
+
+// 判断 vaddr 是否在堆或者栈中
+static bool user_anon_page(task_t *task, u32 vaddr)
+{
+    if (vaddr >= KERNEL_MEMORY_SIZE && vaddr < task->brk)
+        return true;
+    return vaddr >= USER_STACK_BOTTOM && vaddr < USER_STACK_TOP;
+}
+
+// 将 page 所在窗口内还没有映射的堆栈页一起映射，减少缺页次数
+// 读缺页时映射零页，写缺页时映射新的物理页
+static void fault_around(task_t *task, u32 page, bool write)
+{
+    u32 size = fault_around_pages * PAGE_SIZE;
+    if (fault_around_pages <= 1 || free_pages <= fault_around_pages)
+    {
+        return;
+    }
+    assert((fault_around_pages & (fault_around_pages - 1)) == 0);
+
+    u32 start = page & ~(size - 1);
+    for (u32 vaddr = start; vaddr < start + size; vaddr += PAGE_SIZE)
+    {
+        if (vaddr == page || !user_anon_page(task, vaddr))
+        {
+            continue;
+        }
+        if (bitmap_test(task->vmap, IDX(vaddr)))
+        {
+            continue;
+        }
+        if (write)
+            link_page(vaddr);
+        else
+            link_zero_page(vaddr);
+        task->fault_around_mapped++;
+    }
+}
+
+// 写只读的页，拆分共享的页表，复制共享的页
+static void write_protect_fault(task_t *task, u32 vaddr)
+{
+    // 页表可能被共享，先拆分
+    page_entry_t *pte = get_pte(vaddr, true);
+    page_entry_t *entry = &pte[TIDX(vaddr)];
+
+    assert(entry->present);
+    // 只是页表被共享，页本身可写
+    if (entry->write)
+    {
+        LOGK("WRITE page table for 0x%p\n", vaddr);
+        return;
+    }
+    page_t *page = pfn_to_page(entry->index);
+    assert(page->count > 0);
+
+    if (page->count == 1)
+    {
+        entry->write = true;
+        LOGK("WRITE page for 0x%p\n", vaddr);
+    }
+    else
+    {
+        // 零页由内核持有引用，计数总大于 1，第一次写时在这里复制
+        u32 paddr = copy_page((void *)PAGE(IDX(vaddr)));
+        page->count--;
+        entry_init(entry, IDX(paddr));
+        flush_tlb(vaddr);
+        page = pfn_to_page(IDX(paddr));
+        page->owner = task;
+        page->vaddr = PAGE(IDX(vaddr));
+        LOGK("COPY page for 0x%p\n",vaddr);
+    }
+}
+
+// cr0 没有开启 WP，内核写只读页不会触发缺页，写用户内存之前先处理写时复制
+// 没有映射的页在写的时候缺页，由 page_fault 处理
+void prepare_user_write(void *addr, u32 size)
+{
+    if ((u32)addr < KERNEL_MEMORY_SIZE)
+    {
+        return;
+    }
+    task_t *task = running_task();
+    page_entry_t *pde = get_pde();
+    for (u32 vaddr = PAGE(IDX(addr)); vaddr < (u32)addr + size; vaddr += PAGE_SIZE)
+    {
+        page_entry_t *dentry = &pde[DIDX(vaddr)];
+        if (!dentry->present)
+        {
+            continue;
+        }
+        page_entry_t *pte = (page_entry_t *)(PDE_MASK | PAGE(DIDX(vaddr)));
+        page_entry_t *entry = &pte[TIDX(vaddr)];
+        if (entry->present && (!dentry->write || !entry->write))
+        {
+            write_protect_fault(task, vaddr);
+        }
+    }
+}
+
 void page_fault(
     u32 vector,
     u32 edi, u32 esi, u32 ebp, u32 esp,
@@ -569,26 +1200,7 @@ void page_fault(
     if (code->present)
     {
       assert(code->write);
-      page_entry_t *pte = get_pte(vaddr, false);
-      page_entry_t *entry = &pte[TIDX(vaddr)];
-
-      assert(entry->present);
-      assert(memory_map[entry->index] > 0);
-
-      if (memory_map[entry->index] == 1)
-      {
-        entry->write = true;
-        LOGK("WRITE page for 0x%p\n", vaddr);
-      }
-      else
-      {
-        void *page = (void *)PAGE(IDX(vaddr));
-        u32 paddr = copy_page(page);
-        memory_map[entry->index]--;
-        entry_init(entry, IDX(paddr));
-        flush_tlb(vaddr);
-        LOGK("COPY page for 0x%p\n",vaddr);
-      }
+      write_protect_fault(task, vaddr);
       return;
     }
     
@@ -596,7 +1208,11 @@ void page_fault(
     if (!code->present && (vaddr < task->brk || vaddr >= USER_STACK_BOTTOM))
     {
         u32 page = PAGE(IDX(vaddr));
-        link_page(page);
+        if (code->write)
+            link_page(page);
+        else
+            link_zero_page(page);
+        fault_around(task, page, code->write);
         // BMB;
         return;
     }
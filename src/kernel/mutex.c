@@ -3,6 +3,9 @@
 #include <onix/interrupt.h>
 #include <onix/assert.h>
 
+extern u32 volatile jiffies;
+extern u32 jiffy;
+
 void mutex_init(mutex_t *mutex)
 {
   mutex->value = false;
@@ -24,6 +27,31 @@ void mutex_lock(mutex_t *mutex)
   set_interrupt_state(intr);
 }
 
+// 最多等待 ms 毫秒，超时返回 false
+bool mutex_lock_timeout(mutex_t *mutex, u32 ms)
+{
+  bool intr = interrupt_disable();
+  task_t *current = running_task();
+  u32 ticks = ms / jiffy;
+  u32 deadline = jiffies + (ticks > 0 ? ticks : 1);
+  while (mutex->value == true)
+  {
+    int remain = deadline - jiffies;
+    if (remain <= 0)
+    {
+      set_interrupt_state(intr);
+      return false;
+    }
+    task_block_timeout(current, &mutex->waiters, TASK_BLOCKED, remain);
+  }
+  assert(mutex->value == false);
+  mutex->value++;
+  assert(mutex->value == true);
+
+  set_interrupt_state(intr);
+  return true;
+}
+
 void mutex_unlock(mutex_t *mutex)
 {
   bool intr = interrupt_disable();
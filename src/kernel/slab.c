@@ -0,0 +1,192 @@
+#include <onix/slab.h>
+#include <onix/arena.h>
+#include <onix/memory.h>
+#include <onix/string.h>
+#include <onix/stdlib.h>
+#include <onix/assert.h>
+#include <onix/debug.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+#define SLAB_MAX_SIZE (PAGE_SIZE / 8) // slab 中小对象的最大大小
+#define SLAB_EMPTY_KEEP 1             // 保留的空 slab 数量
+
+// slab 页头，后面是空闲对象的链表数组，然后是对象
+typedef struct slab_t
+{
+  list_node_t node;     // 挂在缓存的 partial/full/empty 链表上
+  kmem_cache_t *cache;  // 所属的缓存
+  u32 inuse;            // 使用中的对象数
+  u32 free;             // 第一个空闲对象的序号
+  u32 magic;
+  u16 next[0];          // 下一个空闲对象的序号
+} slab_t;
+
+#define SLAB_END 0xffff
+
+static u32 align_up(u32 value, u32 align)
+{
+  return div_round_up(value, align) * align;
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, u32 size, ctor_t *ctor)
+{
+  assert(size > 0 && (size <= SLAB_MAX_SIZE || size == PAGE_SIZE));
+
+  kmem_cache_t *cache = kmalloc(sizeof(kmem_cache_t));
+  memset(cache, 0, sizeof(kmem_cache_t));
+  assert(strlen(name) < CACHE_NAME_LEN);
+  strcpy(cache->name, name);
+  cache->ctor = ctor;
+  list_init(&cache->partial);
+  list_init(&cache->full);
+  list_init(&cache->empty);
+
+  if (size == PAGE_SIZE)
+  {
+    cache->size = PAGE_SIZE;
+    return cache;
+  }
+
+  cache->size = align_up(size, CACHE_LINE_SIZE);
+
+  // 找到能放下的最多对象数
+  u32 count = (PAGE_SIZE - sizeof(slab_t)) / cache->size;
+  while (align_up(sizeof(slab_t) + count * sizeof(u16), CACHE_LINE_SIZE) +
+             count * cache->size >
+         PAGE_SIZE)
+  {
+    count--;
+  }
+  assert(count > 0);
+  cache->count = count;
+  cache->offset = align_up(sizeof(slab_t) + count * sizeof(u16), CACHE_LINE_SIZE);
+
+  LOGK("cache %s size %d count %d\n", cache->name, cache->size, cache->count);
+  return cache;
+}
+
+static void *slab_object(slab_t *slab, u32 idx)
+{
+  return (void *)slab + slab->cache->offset + idx * slab->cache->size;
+}
+
+// 创建新的 slab，并构造其中所有的对象
+static slab_t *slab_create(kmem_cache_t *cache)
+{
+  slab_t *slab = (slab_t *)alloc_zero_kpage();
+  slab->cache = cache;
+  slab->inuse = 0;
+  slab->free = 0;
+  slab->magic = ONIX_MAGIC;
+  for (size_t i = 0; i < cache->count; i++)
+  {
+    slab->next[i] = (i + 1 < cache->count) ? i + 1 : SLAB_END;
+    if (cache->ctor)
+    {
+      cache->ctor(slab_object(slab, i));
+    }
+  }
+  return slab;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+  if (!cache->count)
+  {
+    // 整页对象，新页已经清零
+    if (cache->page_count)
+    {
+      return (void *)cache->pages[--cache->page_count];
+    }
+    void *page = (void *)alloc_zero_kpage();
+    if (cache->ctor)
+    {
+      cache->ctor(page);
+    }
+    return page;
+  }
+
+  slab_t *slab;
+  if (!list_empty(&cache->partial))
+  {
+    slab = element_entry(slab_t, node, cache->partial.head.next);
+  }
+  else if (!list_empty(&cache->empty))
+  {
+    slab = element_entry(slab_t, node, list_pop(&cache->empty));
+    cache->empty_count--;
+    list_insert_after(&cache->partial.head, &slab->node);
+  }
+  else
+  {
+    slab = slab_create(cache);
+    list_insert_after(&cache->partial.head, &slab->node);
+  }
+
+  assert(slab->free != SLAB_END);
+  u32 idx = slab->free;
+  slab->free = slab->next[idx];
+  slab->inuse++;
+
+  // slab 用完了，移到 full 链表
+  if (slab->inuse == cache->count)
+  {
+    list_remove(&slab->node);
+    list_insert_after(&cache->full.head, &slab->node);
+  }
+  return slab_object(slab, idx);
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+  assert(obj);
+
+  if (!cache->count)
+  {
+    assert(((u32)obj & 0xfff) == 0);
+    if (cache->page_count < CACHE_PAGES)
+    {
+      cache->pages[cache->page_count++] = (u32)obj;
+    }
+    else
+    {
+      free_kpage((u32)obj, 1);
+    }
+    return;
+  }
+
+  slab_t *slab = (slab_t *)((u32)obj & 0xfffff000);
+  assert(slab->magic == ONIX_MAGIC && slab->cache == cache);
+
+  u32 idx = ((u32)obj - (u32)slab - cache->offset) / cache->size;
+  assert(slab_object(slab, idx) == obj);
+
+  bool full = slab->inuse == cache->count;
+  slab->next[idx] = slab->free;
+  slab->free = idx;
+  slab->inuse--;
+
+  if (full)
+  {
+    list_remove(&slab->node);
+    list_insert_after(&cache->partial.head, &slab->node);
+  }
+
+  if (slab->inuse)
+  {
+    return;
+  }
+
+  // slab 全部空闲，保留少量避免反复申请页
+  list_remove(&slab->node);
+  if (cache->empty_count < SLAB_EMPTY_KEEP)
+  {
+    list_insert_after(&cache->empty.head, &slab->node);
+    cache->empty_count++;
+  }
+  else
+  {
+    free_kpage((u32)slab, 1);
+  }
+}
@@ -10,10 +10,13 @@
 #include <onix/global.h>
 #include <onix/arena.h>
 #include <onix/debug.h>
+#include <onix/slab.h>
+#include <onix/timer.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
-#define NR_TASKS 64
+#define PID_MAX 4096    // 最大进程数
+#define PID_HASH_SIZE 256 // pid 散列表桶数
 extern u32 volatile jiffies;
 extern u32 jiffy;
 
@@ -21,27 +24,126 @@ extern bitmap_t kernel_map;
 extern tss_t tss;
 extern void task_switch(task_t *next);
 
-static task_t *task_table[NR_TASKS];    // 任务表
+static u32 pid_map[PID_MAX / 32];       // 已分配的 pid
+static u32 pid_cursor;                  // 下次从这里开始查找，回绕使用
+static task_t *pid_hash[PID_HASH_SIZE]; // pid 到任务的散列表
 static list_t block_list;               // 任务默认阻塞链表
-static list_t sleep_list;               // 任务睡眠链表
+static list_t sleep_list;               // 任务睡眠链表，由定时器唤醒
 static task_t *idle_task;
 
-static task_t *get_free_task()
+#define NR_PRIORITY 32 // 就绪队列的优先级数，更大的优先级放在最高一级
+
+// 就绪队列，每个优先级一个链表，位图记录非空的优先级
+typedef struct prio_array_t
+{
+    u32 bitmap;
+    list_t queue[NR_PRIORITY];
+} prio_array_t;
+
+// 时间片用完的任务放入 expired，active 为空时交换，低优先级任务不会饿死
+static prio_array_t arrays[2];
+static prio_array_t *active = &arrays[0];
+static prio_array_t *expired = &arrays[1];
+
+#define FAIR_DEFAULT_PRIORITY 5
+#define FAIR_TICK_VRUNTIME 0x1000                  // 默认优先级的任务每个时钟周期增加的 vruntime
+#define FAIR_GRANULARITY FAIR_TICK_VRUNTIME        // 领先超过这个值时被抢占
+#define FAIR_SLEEPER_CREDIT (3 * FAIR_TICK_VRUNTIME) // 唤醒的任务最多落后 min_vruntime 的值
+
+// SCHED_FAIR 就绪任务按 vruntime 排序，最左边的最先执行
+static rb_root_t fair_tree;
+static u32 fair_min_vruntime; // 只增不减，新建和唤醒的任务以此为基准
+static bool need_resched;
+
+static kmem_cache_t *task_cache;   // 任务页，同时是内核栈，释放时需要清零
+static kmem_cache_t *bitmap_cache; // 进程虚拟内存位图
+static kmem_cache_t *vmap_cache;   // 进程虚拟内存位图缓冲区，释放时需要清零
+
+// 从 pid_cursor 开始找一个空闲的 pid，到末尾后回绕
+static pid_t pid_alloc()
 {
-    for (size_t i = 0; i < NR_TASKS; i++)
+    u32 word = pid_cursor / 32;
+    for (size_t i = 0; i <= PID_MAX / 32; i++, word = (word + 1) % (PID_MAX / 32))
     {
-        if (task_table[i] == NULL)
+        u32 free = ~pid_map[word];
+        // 第一个字只查找 pid_cursor 之后的
+        if (i == 0)
         {
-            task_t *task = (task_t *)alloc_kpage(1); // todo free_kpage
-            memset(task, 0, PAGE_SIZE);
-            task->pid = i;
-            task_table[i] = task;
-            return task;
+            free &= ~0u << (pid_cursor % 32);
+        }
+        if (!free)
+        {
+            continue;
         }
+        pid_t pid = word * 32 + __builtin_ctz(free);
+        pid_map[word] |= 1 << (pid % 32);
+        pid_cursor = (pid + 1) % PID_MAX;
+        return pid;
     }
     panic("no more tasks");
 }
 
+static u32 pid_hashfn(pid_t pid)
+{
+    return pid % PID_HASH_SIZE;
+}
+
+// 根据 pid 查找任务，没有返回 NULL
+task_t *task_lookup(pid_t pid)
+{
+    for (task_t *task = pid_hash[pid_hashfn(pid)]; task; task = task->hash_next)
+    {
+        if (task->pid == pid)
+        {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static task_t *get_free_task()
+{
+    task_t *task = (task_t *)kmem_cache_alloc(task_cache);
+    task->pid = pid_alloc();
+    return task;
+}
+
+// 任务加入 pid 散列表，fork 和 spawn 要在复制父进程之后调用
+static void task_hash(task_t *task)
+{
+    u32 idx = pid_hashfn(task->pid);
+    task->hash_next = pid_hash[idx];
+    pid_hash[idx] = task;
+}
+
+// 释放已经退出的任务，回收 pid 和任务页
+static void put_task(task_t *task)
+{
+    assert(task->state == TASK_DIED);
+    assert(task != running_task());
+
+    task_t **link = &pid_hash[pid_hashfn(task->pid)];
+    while (*link != task)
+    {
+        assert(*link);
+        link = &(*link)->hash_next;
+    }
+    *link = task->hash_next;
+    pid_map[task->pid / 32] &= ~(1 << (task->pid % 32));
+
+    // 任务页缓存要求释放时是清零的
+    memset(task, 0, PAGE_SIZE);
+    kmem_cache_free(task_cache, task);
+}
+
+// 新的子进程加入父进程的 children 链表
+static void task_add_child(task_t *parent, task_t *child)
+{
+    child->ppid = parent->pid;
+    list_init(&child->children);
+    list_insert_before(&parent->children.tail, &child->sibling);
+}
+
 // 获取进程 id
 pid_t sys_getpid()
 {
@@ -56,24 +158,171 @@ pid_t sys_getppid()
     return task->ppid;
 }
 
-static task_t *task_search(task_state_t state)
+static u32 task_level(task_t *task)
+{
+    return task->priority < NR_PRIORITY ? task->priority : NR_PRIORITY - 1;
+}
+
+static void array_enqueue(prio_array_t *array, task_t *task)
+{
+    u32 level = task_level(task);
+    list_insert_before(&array->queue[level].tail, &task->node);
+    array->bitmap |= 1 << level;
+}
+
+// vruntime 可能回绕，比较差值
+static bool vruntime_before(u32 a, u32 b)
+{
+    return (int)(a - b) < 0;
+}
+
+static void fair_enqueue(task_t *task)
+{
+    rb_node_t **link = &fair_tree.node;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+    while (*link)
+    {
+        parent = *link;
+        task_t *entry = element_entry(task_t, rb, parent);
+        if (vruntime_before(task->vruntime, entry->vruntime))
+        {
+            link = &parent->left;
+        }
+        else
+        {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+    rb_insert(&fair_tree, &task->rb, parent, link, leftmost);
+}
+
+static task_t *fair_first()
+{
+    if (!fair_tree.leftmost)
+    {
+        return NULL;
+    }
+    return element_entry(task_t, rb, fair_tree.leftmost);
+}
+
+// 用当前任务和最左边任务中较小的 vruntime 推进 min_vruntime
+static void fair_update_min(task_t *current)
+{
+    task_t *first = fair_first();
+    u32 vruntime;
+    if (current->policy == SCHED_FAIR && current->state == TASK_RUNNING)
+    {
+        vruntime = current->vruntime;
+        if (first && vruntime_before(first->vruntime, vruntime))
+        {
+            vruntime = first->vruntime;
+        }
+    }
+    else if (first)
+    {
+        vruntime = first->vruntime;
+    }
+    else
+    {
+        return;
+    }
+    if (vruntime_before(fair_min_vruntime, vruntime))
+    {
+        fair_min_vruntime = vruntime;
+    }
+}
+
+// vruntime 落后 min_vruntime 太多的任务从 floor 开始，避免长时间独占
+static void fair_place(task_t *task, u32 credit)
+{
+    u32 floor = fair_min_vruntime - credit;
+    if (vruntime_before(task->vruntime, floor))
+    {
+        task->vruntime = floor;
+    }
+}
+
+// 就绪任务加入就绪队列
+static void task_enqueue(task_t *task)
+{
+    assert(task->state == TASK_READY);
+    assert(task->node.next == NULL && task->node.prev == NULL);
+    if (task->policy == SCHED_FAIR)
+    {
+        fair_enqueue(task);
+        return;
+    }
+    array_enqueue(active, task);
+}
+
+// 从就绪队列中移除，任务可能在任意一个数组中
+static void task_dequeue(task_t *task)
+{
+    if (task->policy == SCHED_FAIR)
+    {
+        rb_erase(&fair_tree, &task->rb);
+        return;
+    }
+
+    u32 level = task_level(task);
+    list_remove(&task->node);
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (list_empty(&arrays[i].queue[level]))
+        {
+            arrays[i].bitmap &= ~(1 << level);
+        }
+    }
+}
+
+// 唤醒的任务是否应该抢占当前任务
+static void task_check_preempt(task_t *task)
 {
-    assert(!get_interrupt_state());
-    task_t *task = NULL;
     task_t *current = running_task();
-    for (size_t i = 0; i < NR_TASKS; i++)
+    if (current == idle_task || current->state != TASK_RUNNING)
+    {
+        need_resched = true;
+    }
+    else if (current->policy == SCHED_FAIR && task->policy == SCHED_PRIO)
+    {
+        need_resched = true;
+    }
+    else if (current->policy == SCHED_FAIR &&
+             vruntime_before(task->vruntime + FAIR_GRANULARITY, current->vruntime))
+    {
+        need_resched = true;
+    }
+}
+
+// 取出下一个要执行的任务，先 SCHED_PRIO 再 SCHED_FAIR，都没有时返回空闲任务
+static task_t *task_pick()
+{
+    assert(!get_interrupt_state());
+    if (!active->bitmap)
+    {
+        prio_array_t *array = active;
+        active = expired;
+        expired = array;
+    }
+    if (!active->bitmap)
     {
-        task_t *ptr = task_table[i];
-        if (ptr == NULL || ptr->state != state || current == ptr)
+        task_t *task = fair_first();
+        if (!task)
         {
-            continue;
+            return idle_task;
         }
-        if (task == NULL || task->ticks < ptr->ticks || ptr->jiffies < task->jiffies)
-            task = ptr;
+        rb_erase(&fair_tree, &task->rb);
+        return task;
     }
-    if (task == NULL && state == TASK_READY)
+
+    u32 level = 31 - __builtin_clz(active->bitmap);
+    list_t *queue = &active->queue[level];
+    task_t *task = element_entry(task_t, node, list_pop(queue));
+    if (list_empty(queue))
     {
-        task = idle_task;
+        active->bitmap &= ~(1 << level);
     }
     return task;
 }
@@ -93,13 +342,17 @@ task_t *running_task()
 void task_block(task_t *task, list_t *blist, task_state_t state)
 {
     assert(!get_interrupt_state());
+    if (task->state == TASK_READY)
+    {
+        task_dequeue(task);
+    }
     assert(task->node.next == NULL);
     assert(task->node.prev == NULL);
     if (blist == NULL)
     {
         blist = &block_list;
     }
-    list_push(blist, &task->node);
+    list_insert_after(&blist->head, &task->node);
     assert(state != TASK_READY && state != TASK_RUNNING);
     task->state = state;
     task_t *current = running_task();
@@ -116,6 +369,37 @@ void task_unblock(task_t *task)
     assert(task->node.next == NULL);
     assert(task->node.prev == NULL);
     task->state = TASK_READY;
+    if (task->policy == SCHED_FAIR)
+    {
+        fair_place(task, FAIR_SLEEPER_CREDIT);
+    }
+    task_enqueue(task);
+    task_check_preempt(task);
+}
+
+// 超时定时器到期，任务还在阻塞时唤醒
+static void task_timeout(timer_t *timer)
+{
+    task_t *task = (task_t *)timer->data;
+    if (task->state == TASK_READY || task->state == TASK_RUNNING)
+    {
+        return;
+    }
+    task_unblock(task);
+}
+
+// 阻塞当前任务，最多等待 ticks 个时钟周期
+// 返回 false 表示定时器已经到期，调用者需要重新检查等待的条件
+bool task_block_timeout(task_t *task, list_t *blist, task_state_t state, u32 ticks)
+{
+    assert(task == running_task());
+    timer_t timer;
+    timer_setup(&timer, task_timeout, task);
+    timer_add(&timer, jiffies + ticks);
+    task_block(task, blist, state);
+    bool pending = timer_pending(&timer);
+    timer_del(&timer);
+    return pending;
 }
 
 void task_sleep(u32 ms)
@@ -125,45 +409,39 @@ void task_sleep(u32 ms)
     ticks = ticks > 0 ? ticks : 1;
 
     task_t *current = running_task();
-    current->ticks = jiffies + ticks;
-    list_t *list = &sleep_list;
-    list_node_t *anchor = &list->tail;
+    task_block_timeout(current, &sleep_list, TASK_SLEEPING, ticks);
+}
+
+void task_tick(task_t *task)
+{
+    task->ticks--;
+    if (!task->ticks)
+    {
+        need_resched = true;
+    }
 
-    for (list_node_t *ptr = list->head.next; ptr != &list->tail; ptr = ptr->next)
+    if (task->policy == SCHED_FAIR && task != idle_task)
     {
-        task_t *task = element_entry(task_t, node, ptr);
-        if (current->ticks < task->ticks)
+        // 优先级越高 vruntime 增长越慢，得到的 CPU 时间越多
+        u32 priority = task->priority ? task->priority : 1;
+        task->vruntime += FAIR_TICK_VRUNTIME * FAIR_DEFAULT_PRIORITY / priority;
+        fair_update_min(task);
+
+        task_t *first = fair_first();
+        if (first && vruntime_before(first->vruntime + FAIR_GRANULARITY, task->vruntime))
         {
-            anchor = ptr;
-            break;
+            need_resched = true;
         }
     }
-    assert(current->node.next == NULL);
-    assert(current->node.prev == NULL);
-
-    list_insert_before(anchor, &current->node);
-    current->state = TASK_SLEEPING;
-    schedule();
+    task_preempt();
 }
 
-void task_wakeup()
+void task_preempt()
 {
-    assert(!get_interrupt_state()); // 不可中断
-    list_t *list = &sleep_list;
-    for (list_node_t *ptr = list->head.next; ptr != &list->tail;)
+    assert(!get_interrupt_state());
+    if (need_resched)
     {
-        task_t *task = element_entry(task_t, node, ptr);
-        // jiffies随着时间增加
-        if (jiffies < task->ticks)
-        {
-            break;
-        }
-        // unblock 会将指针清空
-        ptr = ptr->next;
-        // task->node.next = NULL;
-        // task->node.prev = NULL;
-        task->ticks = 0;
-        task_unblock(task);
+        schedule();
     }
 }
 
@@ -186,17 +464,30 @@ void schedule()
 {
     assert(!get_interrupt_state());
     task_t *current = running_task();
-    task_t *next = task_search(TASK_READY);
-    assert(next != NULL);
-    assert(next ->magic == ONIX_MAGIC);
-    if (current->state == TASK_RUNNING)
+    need_resched = false;
+    bool expire = !current->ticks;
+    if (expire)
     {
-        current->state = TASK_READY;
+        current->ticks = current->priority;
     }
-    if (!current->ticks)
+    if (current->state == TASK_RUNNING)
     {
-        current->ticks = current->priority;
+        current->state = TASK_READY;
+        if (current != idle_task && current->policy == SCHED_FAIR)
+        {
+            fair_enqueue(current);
+        }
+        else if (current != idle_task)
+        {
+            // 时间片用完的放入 expired，等 active 中的任务都执行过再执行
+            array_enqueue(expire ? expired : active, current);
+        }
     }
+    fair_update_min(current);
+
+    task_t *next = task_pick();
+    assert(next != NULL);
+    assert(next->magic == ONIX_MAGIC);
     next->state = TASK_RUNNING;
     if (next == current)
     {
@@ -209,6 +500,7 @@ void schedule()
 static task_t *task_create(target_t target, const char *name, u32 priority, u32 uid)
 {
     task_t *task = get_free_task();
+    task_hash(task);
     u32 stack = (u32)task + PAGE_SIZE;
 
     stack -= sizeof(task_frame_t);
@@ -220,6 +512,9 @@ static task_t *task_create(target_t target, const char *name, u32 priority, u32
     frame->eip = (void *)target;
 
     strcpy((char *)task->name, name);
+    task->ppid = 0;
+    task->waitpid = 0;
+    list_init(&task->children);
     task->stack = (u32 *)stack;
     task->priority = priority;
     task->ticks = task->priority;
@@ -230,6 +525,9 @@ static task_t *task_create(target_t target, const char *name, u32 priority, u32
     task->pde = KERNEL_PAGE_DIR;
     task->magic = ONIX_MAGIC;
     task->brk = KERNEL_MEMORY_SIZE;
+    task->policy = SCHED_PRIO;
+    task->vruntime = fair_min_vruntime;
+    task_enqueue(task);
     return task;
 }
 
@@ -240,13 +538,20 @@ void task_to_user_mode(target_t target)
     task_t *task = running_task();
 
     // 创建用户进程虚拟内存位图
-    task->vmap = kmalloc(sizeof(bitmap_t));
-    void *buf = (void *)alloc_kpage(1);
+    task->vmap = kmem_cache_alloc(bitmap_cache);
+    void *buf = kmem_cache_alloc(vmap_cache);
     bitmap_init(task->vmap, buf, PAGE_SIZE, KERNEL_MEMORY_SIZE / PAGE_SIZE);
     
     task->pde = (u32)copy_pde();
     set_cr3(task->pde);
 
+    // 堆的第一页一开始就在 brk 之内
+    task->brk = USER_HEAP_START;
+
+    // 用户进程公平调度，当前任务不在就绪队列中，可以直接修改
+    task->policy = SCHED_FAIR;
+    task->vruntime = fair_min_vruntime;
+
     u32 addr = (u32)task + PAGE_SIZE;
 
     addr -= sizeof(intr_frame_t);
@@ -307,23 +612,70 @@ pid_t task_fork()
     memcpy(child, task, PAGE_SIZE);
 
     child->pid = pid;
-    child->ppid = task->pid;
+    task_hash(child);
+    task_add_child(task, child);
     child->ticks = child->priority;
     child->state = TASK_READY;
 
-    child->vmap = kmalloc(sizeof(bitmap_t));
+    child->vparent = NULL;
+    child->fault_around_mapped = 0;
+
+    child->vmap = kmem_cache_alloc(bitmap_cache);
     memcpy(child->vmap, task->vmap, sizeof(bitmap_t));
 
-    void *buf = (void *)alloc_kpage(1);
+    void *buf = kmem_cache_alloc(vmap_cache);
     memcpy(buf, task->vmap->bits, PAGE_SIZE);
     child->vmap->bits = buf;
 
     child->pde = (u32)copy_pde();
 
     task_build_statck(child);
+    fair_place(child, 0);
+    task_enqueue(child);
     return child->pid;
 }
 
+// 子进程借用父进程的页目录和虚拟内存位图，父进程挂起直到子进程退出
+// start 为子进程在用户态的入口，要执行的函数和参数在 ecx 和 edx 中，
+// 作为 start 的两个参数放在子进程的用户栈上
+pid_t task_spawn(target_t start)
+{
+    task_t *task = running_task();
+    assert(task->uid != KERNEL_USER);
+    assert(task->node.next == NULL && task->node.prev == NULL && task->state == TASK_RUNNING);
+    task_t *child = get_free_task();
+    pid_t pid = child->pid;
+    memcpy(child, task, PAGE_SIZE);
+
+    child->pid = pid;
+    task_hash(child);
+    task_add_child(task, child);
+    child->ticks = child->priority;
+    child->state = TASK_READY;
+    child->vparent = task;
+    child->fault_around_mapped = 0;
+
+    task_build_statck(child);
+
+    // 子进程的用户栈放在父进程栈顶之下，父进程挂起期间不会被使用
+    intr_frame_t *parent = (intr_frame_t *)((u32)task + PAGE_SIZE - sizeof(intr_frame_t));
+    intr_frame_t *iframe = (intr_frame_t *)((u32)child + PAGE_SIZE - sizeof(intr_frame_t));
+    iframe->eip = (u32)start;
+
+    // 像 call 一样压入参数和返回地址，调用处的栈按 16 字节对齐
+    u32 *stack = (u32 *)(((parent->esp - 0x10) & ~0xf) - 0x10);
+    prepare_user_write(stack - 1, 3 * sizeof(u32));
+    stack[-1] = 0;
+    stack[0] = parent->ecx;
+    stack[1] = parent->edx;
+    iframe->esp = (u32)(stack - 1);
+    fair_place(child, 0);
+    task_enqueue(child);
+
+    task_block(task, NULL, TASK_WAITING);
+    return pid;
+}
+
 void task_exit(int status)
 {
     task_t *task = running_task();
@@ -333,24 +685,80 @@ void task_exit(int status)
     task->state = TASK_DIED;
     task->status = status;
 
-    free_pde();
-    free_kpage((u32)task->vmap->bits, 1);
-    kfree(task->vmap);
-    for (size_t i = 0; i < NR_TASKS; i++)
+    if (task->vparent)
+    {
+        // 地址空间是借用的，归还给父进程
+        task->vparent->brk = task->brk;
+        task_unblock(task->vparent);
+    }
+    else
+    {
+        free_pde();
+        // 整页缓存要求释放时是清零的
+        memset(task->vmap->bits, 0, PAGE_SIZE);
+        kmem_cache_free(vmap_cache, task->vmap->bits);
+        kmem_cache_free(bitmap_cache, task->vmap);
+    }
+    // 子进程交给父进程
+    task_t *parent = task_lookup(task->ppid);
+    assert(parent);
+    bool zombie = false;
+    while (!list_empty(&task->children))
+    {
+        task_t *child = element_entry(task_t, sibling, list_pop(&task->children));
+        child->ppid = parent->pid;
+        list_insert_before(&parent->children.tail, &child->sibling);
+        zombie |= child->state == TASK_DIED;
+    }
+
+    // 通知在 waitpid 中等待的父进程
+    if (parent->waitpid == -1 || parent->waitpid == task->pid || (zombie && parent->waitpid))
     {
-        task_t *child = task_table[i];
-        if (!child)
+        parent->waitpid = 0;
+        task_unblock(parent);
+    }
+    LOGK("task 0x%p exit, fault around mapped %d pages....\n", task, task->fault_around_mapped);
+    schedule();    
+}
+
+// 等待子进程退出并回收，pid 为 -1 时等待任意子进程
+// 返回子进程 pid，没有符合的子进程时返回 -1
+pid_t task_waitpid(pid_t pid, int32 *status)
+{
+    task_t *task = running_task();
+    while (true)
+    {
+        bool found = false;
+        for (list_node_t *ptr = task->children.head.next; ptr != &task->children.tail; ptr = ptr->next)
         {
-            continue;
+            task_t *child = element_entry(task_t, sibling, ptr);
+            if (pid != -1 && child->pid != pid)
+            {
+                continue;
+            }
+            found = true;
+            if (child->state != TASK_DIED)
+            {
+                continue;
+            }
+
+            pid_t cpid = child->pid;
+            if (status)
+            {
+                prepare_user_write(status, sizeof(*status));
+                *status = child->status;
+            }
+            list_remove(&child->sibling);
+            put_task(child);
+            return cpid;
         }
-        if (child->ppid != task->pid)
+        if (!found)
         {
-            continue;
+            return -1;
         }
-        child->ppid = task->ppid;
+        task->waitpid = pid;
+        task_block(task, NULL, TASK_WAITING);
     }
-    LOGK("task 0x%p exit....\n", task);
-    schedule();    
 }
 
 static void task_setup()
@@ -358,7 +766,8 @@ static void task_setup()
     task_t *task = running_task();
     task->magic = ONIX_MAGIC;
     task->ticks = 1;
-    memset(task_table, 0, sizeof(task_table));
+    memset(pid_map, 0, sizeof(pid_map));
+    memset(pid_hash, 0, sizeof(pid_hash));
 }
 
 extern void idle_thread();
@@ -369,8 +778,19 @@ void task_init()
 {
     list_init(&block_list);
     list_init(&sleep_list);
+    rb_init(&fair_tree);
+    for (size_t i = 0; i < NR_PRIORITY; i++)
+    {
+        list_init(&arrays[0].queue[i]);
+        list_init(&arrays[1].queue[i]);
+    }
+    task_cache = kmem_cache_create("task", PAGE_SIZE, NULL);
+    bitmap_cache = kmem_cache_create("bitmap", sizeof(bitmap_t), NULL);
+    vmap_cache = kmem_cache_create("vmap", PAGE_SIZE, NULL);
     task_setup();
     idle_task = task_create(idle_thread, "idle", 1, KERNEL_USER);
+    // 空闲任务不在就绪队列中，没有其他就绪任务时才执行
+    task_dequeue(idle_task);
     task_create(init_thread, "init", 5, NORMAL_USER);
     task_create(test_thread, "test", 5, KERNEL_USER);
 }
@@ -7,11 +7,17 @@
 #include <onix/task.h>
 #include <onix/stdio.h>
 #include <onix/stdlib.h>
+#include <onix/time.h>
+#include <onix/memory.h>
+#include <onix/assert.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
 mutex_t mutex;
 
+extern void clock_idle_enter();
+extern void clock_idle_exit();
+
 void idle_thread()
 {
     set_interrupt_state(true);
@@ -19,15 +25,28 @@ void idle_thread()
     while (true)
     {
         // LOGK("idle task.... %d\n", counter++);
-        asm volatile(
-            "sti\n" // 开中断
-            "hlt\n" // 关闭 CPU，进入暂停状态，等待外中断的到来
-        );
+        // 空闲时先预先清零物理页，没有工作再暂停
+        if (!zero_pool_refill())
+        {
+            // 暂停期间时钟只在最近的睡眠到期时中断
+            interrupt_disable();
+            clock_idle_enter();
+            asm volatile(
+                "sti\n" // 开中断
+                "hlt\n" // 关闭 CPU，进入暂停状态，等待外中断的到来
+            );
+            interrupt_disable();
+            clock_idle_exit();
+            set_interrupt_state(true);
+        }
         yield(); // 放弃执行权，调度执行其他任务
     }
 }
 
 extern u32 keyboard_read(char *buf, u32 count);
+extern u32 keyboard_read_timeout(char *buf, u32 count, u32 ms);
+extern u32 volatile jiffies;
+extern u32 jiffy;
 
 void test_recursion()
 {
@@ -35,6 +54,185 @@ void test_recursion()
     test_recursion();
 }
 
+static int spawn_child(void *arg)
+{
+    return (int)arg;
+}
+
+#define BENCH_ROUNDS 16
+
+// 比较 fork 和 spawn 创建立即退出的子进程的开销
+// 两边都包括创建、子进程执行和退出以及回收
+void spawn_bench()
+{
+    u64 start = rdtsc();
+    for (size_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        pid_t pid = fork();
+        if (!pid)
+        {
+            exit(0);
+        }
+        waitpid(pid, NULL);
+    }
+    u32 forked = (u32)((rdtsc() - start) / BENCH_ROUNDS);
+
+    start = rdtsc();
+    for (size_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        int32 status;
+        pid_t pid = spawn(spawn_child, (void *)i);
+        waitpid(pid, &status);
+        // 参数经过子进程的用户栈传递，退出状态就是参数
+        if (status != i)
+        {
+            printf("spawn child %d status %d\n", i, status);
+            return;
+        }
+    }
+    u32 spawned = (u32)((rdtsc() - start) / BENCH_ROUNDS);
+
+    printf("fork+exit %d cycles, spawn+exit %d cycles\n", forked, spawned);
+}
+
+#define MALLOC_BENCH_COUNT 64
+
+// 比较 malloc/free 和每次分配都调用 brk 的开销
+void malloc_bench()
+{
+    static void *ptrs[MALLOC_BENCH_COUNT];
+    u32 sizes[] = {16, 100, 500, 2000, 6000};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(u32); s++)
+    {
+        u64 start = rdtsc();
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            for (size_t i = 0; i < MALLOC_BENCH_COUNT; i++)
+            {
+                ptrs[i] = malloc(sizes[s]);
+                *(u32 *)ptrs[i] = i;
+            }
+            for (size_t i = 0; i < MALLOC_BENCH_COUNT; i++)
+            {
+                free(ptrs[i]);
+            }
+        }
+        u32 cycles = (u32)((rdtsc() - start) / (BENCH_ROUNDS * MALLOC_BENCH_COUNT));
+        printf("malloc+free %d bytes %d cycles\n", sizes[s], cycles);
+    }
+
+    u32 base = USER_HEAP_START + 0x100000;
+    u64 start = rdtsc();
+    for (size_t r = 0; r < BENCH_ROUNDS; r++)
+    {
+        brk((void *)(base + PAGE_SIZE));
+        *(u32 *)base = r;
+        brk((void *)base);
+    }
+    u32 cycles = (u32)((rdtsc() - start) / BENCH_ROUNDS);
+    printf("brk grow+touch+shrink %d cycles\n", cycles);
+}
+
+#define FAIR_BENCH_HOGS 3
+#define FAIR_BENCH_ROUNDS 20
+#define FAIR_BENCH_SLEEP 10
+
+// 几个计算任务同时执行，比较各自的循环次数，同时测量睡眠任务的唤醒延迟
+void fair_bench()
+{
+    // 空闲时睡眠的耗时作为基准
+    u64 start = rdtsc();
+    sleep(FAIR_BENCH_SLEEP);
+    u32 base = (u32)(rdtsc() - start);
+    u32 run = base * FAIR_BENCH_ROUNDS * 2;
+
+    for (size_t i = 0; i < FAIR_BENCH_HOGS; i++)
+    {
+        if (fork())
+            continue;
+
+        u32 count = 0;
+        start = rdtsc();
+        while ((u32)(rdtsc() - start) < run)
+        {
+            count++;
+        }
+        printf("hog %d count %d\n", i, count);
+        exit(0);
+    }
+
+    if (!fork())
+    {
+        u32 total = 0;
+        u32 max = 0;
+        for (size_t i = 0; i < FAIR_BENCH_ROUNDS; i++)
+        {
+            start = rdtsc();
+            sleep(FAIR_BENCH_SLEEP);
+            u32 latency = (u32)(rdtsc() - start);
+            latency = latency > base ? latency - base : 0;
+            total += latency;
+            max = MAX(max, latency);
+        }
+        printf("wakeup latency avg %d max %d cycles\n", total / FAIR_BENCH_ROUNDS, max);
+        exit(0);
+    }
+    while (waitpid(-1, NULL) != -1)
+        ;
+}
+
+#define FORK_CHURN_ROUNDS 10000
+#define FORK_CHURN_SLEEP 1000
+#define FORK_CHURN_STATUS 0x5a
+
+// 反复创建并回收子进程，轮数超过 pid 数量，泄漏任务页或 pid 时会失败
+// 一直存在的子进程和 init 与后面的 pid 在散列表的同一个桶中
+void fork_churn_test()
+{
+    pid_t keeper = fork();
+    if (!keeper)
+    {
+        sleep(FORK_CHURN_SLEEP);
+        exit(FORK_CHURN_STATUS);
+    }
+
+    pid_t ppid = getpid();
+    for (size_t i = 0; i < FORK_CHURN_ROUNDS; i++)
+    {
+        pid_t pid = fork();
+        if (!pid)
+        {
+            exit(getppid() == ppid ? i & 0xff : -1);
+        }
+
+        int32 status;
+        pid_t ret = waitpid(pid, &status);
+        if (ret != pid || status != (i & 0xff))
+        {
+            printf("fork churn fail round %d pid %d ret %d status %d\n", i, pid, ret, status);
+            return;
+        }
+        if (i % 1000 == 0)
+        {
+            printf("fork churn round %d pid %d\n", i, pid);
+        }
+    }
+
+    int32 status;
+    if (waitpid(keeper, &status) != keeper || status != FORK_CHURN_STATUS)
+    {
+        printf("fork churn fail keeper %d status %d\n", keeper, status);
+        return;
+    }
+    if (waitpid(-1, NULL) != -1)
+    {
+        printf("fork churn fail unreaped child\n");
+        return;
+    }
+    printf("fork churn %d rounds ok\n", FORK_CHURN_ROUNDS);
+}
+
 static void user_init_thread()
 {
     u32 counter = 0;
@@ -42,6 +240,10 @@ static void user_init_thread()
     while (true)
     {
         // test();
+        // spawn_bench();
+        // malloc_bench();
+        // fair_bench();
+        // fork_churn_test();
         // printf("init thread %d %d %d...\n", getpid(), getppid(), counter++);
         // printf("task is in user mode %d\n", counter++);
         pid_t pid = fork();
@@ -49,6 +251,8 @@ static void user_init_thread()
         if (pid)
         {
             printf("fork after parent %d, %d, %d\n", pid, getpid(), getppid());
+            int32 status;
+            waitpid(pid, &status);
         }
         else
         {
@@ -66,8 +270,56 @@ void init_thread()
     task_to_user_mode(user_init_thread);
 }
 
+#define TIMED_WAIT_MS 50
+
+// 检查等待的时钟周期数，至少是超时时间，唤醒之后调度最多再晚两个周期
+static void timed_wait_check(const char *name, u32 start, u32 ms)
+{
+    u32 ticks = jiffies - start;
+    u32 expect = ms / jiffy;
+    printk("%s timed out after %d ticks\n", name, ticks);
+    assert(ticks >= expect && ticks <= expect + 2);
+}
+
+// 内核线程中调用，检查互斥量和键盘的超时等待
+void timed_wait_test()
+{
+    mutex_t lock;
+    mutex_init(&lock);
+
+    // 自己持有互斥量，只能超时返回
+    mutex_lock(&lock);
+    u32 start = jiffies;
+    assert(!mutex_lock_timeout(&lock, TIMED_WAIT_MS));
+    timed_wait_check("mutex", start, TIMED_WAIT_MS);
+
+    mutex_unlock(&lock);
+    start = jiffies;
+    assert(mutex_lock_timeout(&lock, TIMED_WAIT_MS));
+    assert(jiffies - start <= 1);
+    mutex_unlock(&lock);
+
+    // 和系统调用一样在关中断时读取，没有按键时超时返回 0
+    char ch;
+    bool intr = interrupt_disable();
+    start = jiffies;
+    u32 nr = keyboard_read_timeout(&ch, 1, TIMED_WAIT_MS);
+    set_interrupt_state(intr);
+    if (nr == 0)
+    {
+        timed_wait_check("keyboard", start, TIMED_WAIT_MS);
+    }
+
+    printk("press a key in 5 seconds...\n");
+    intr = interrupt_disable();
+    nr = keyboard_read_timeout(&ch, 1, 5000);
+    set_interrupt_state(intr);
+    printk("keyboard read %d chars\n", nr);
+}
+
 void test_thread()
 {
+    // timed_wait_test();
     u32 counter = 0;
     while (true)
     {
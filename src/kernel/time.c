@@ -105,6 +105,15 @@ int get_yday(tm *time)
 }
 
 
+// 读取时间戳计数器
+u64 rdtsc()
+{
+    u64 tsc;
+    asm volatile("rdtsc\n"
+                 : "=A"(tsc));
+    return tsc;
+}
+
 void time_read_bcd(tm *time)
 {
     // CMOS 的访问速度很慢。为了减小时间误差，在读取了下面循环中所有数值后，
@@ -0,0 +1,290 @@
+#include <onix/timer.h>
+#include <onix/interrupt.h>
+#include <onix/assert.h>
+#include <onix/debug.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+// 分层时间轮，第一层每个槽一个时钟周期，之后每层的槽覆盖上一层的一整圈
+// 高层的定时器在低层转完一圈时降级到低层，插入和删除都是 O(1) 的
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS 4
+
+extern u32 volatile jiffies;
+
+static list_t tv1[TVR_SIZE];
+static list_t tvn[TVN_LEVELS][TVN_SIZE];
+static u32 timer_jiffies; // 下一个要处理的时钟周期
+
+// 第 level 层中 timer_jiffies 对应的槽
+static u32 tvn_index(u32 level)
+{
+    return (timer_jiffies >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+}
+
+static void internal_add(timer_t *timer)
+{
+    u32 expires = timer->expires;
+    u32 idx = expires - timer_jiffies;
+    list_t *vec;
+
+    if ((int)idx < 0)
+    {
+        // 已经到期，下一个时钟周期处理
+        vec = &tv1[timer_jiffies & TVR_MASK];
+    }
+    else if (idx < TVR_SIZE)
+    {
+        vec = &tv1[expires & TVR_MASK];
+    }
+    else
+    {
+        u32 level = 0;
+        while (level < TVN_LEVELS - 1 && idx >= 1 << (TVR_BITS + (level + 1) * TVN_BITS))
+        {
+            level++;
+        }
+        vec = &tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+    list_insert_before(&vec->tail, &timer->node);
+}
+
+// 把第 level 层 index 槽中的定时器放回低层，返回 index
+static u32 cascade(u32 level, u32 index)
+{
+    list_t *vec = &tvn[level][index];
+    while (!list_empty(vec))
+    {
+        timer_t *timer = element_entry(timer_t, node, list_pop(vec));
+        internal_add(timer);
+    }
+    return index;
+}
+
+void timer_setup(timer_t *timer, timer_func_t *func, void *data)
+{
+    timer->node.next = NULL;
+    timer->node.prev = NULL;
+    timer->func = func;
+    timer->data = data;
+    timer->expires = 0;
+}
+
+bool timer_pending(timer_t *timer)
+{
+    return timer->node.next != NULL;
+}
+
+void timer_add(timer_t *timer, u32 expires)
+{
+    bool intr = interrupt_disable();
+    assert(!timer_pending(timer));
+    timer->expires = expires;
+    internal_add(timer);
+    set_interrupt_state(intr);
+}
+
+void timer_del(timer_t *timer)
+{
+    bool intr = interrupt_disable();
+    if (timer_pending(timer))
+    {
+        list_remove(&timer->node);
+    }
+    set_interrupt_state(intr);
+}
+
+void timer_mod(timer_t *timer, u32 expires)
+{
+    bool intr = interrupt_disable();
+    timer_del(timer);
+    timer_add(timer, expires);
+    set_interrupt_state(intr);
+}
+
+void timer_run()
+{
+    assert(!get_interrupt_state());
+    while ((int)(jiffies - timer_jiffies) >= 0)
+    {
+        u32 index = timer_jiffies & TVR_MASK;
+
+        // 第一层转完一圈，从上一层降级一个槽，依此类推
+        if (!index)
+        {
+            for (size_t level = 0; level < TVN_LEVELS; level++)
+            {
+                if (cascade(level, tvn_index(level)))
+                    break;
+            }
+        }
+        timer_jiffies++;
+
+        list_t *vec = &tv1[index];
+        while (!list_empty(vec))
+        {
+            timer_t *timer = element_entry(timer_t, node, list_pop(vec));
+            timer->func(timer);
+        }
+    }
+}
+
+u32 timer_next(u32 max)
+{
+    assert(!get_interrupt_state());
+    // 还有没处理的时钟周期，偏移从 jiffies 算起，需要立即处理
+    if (timer_jiffies != jiffies)
+        return 0;
+    for (u32 i = 0; i < max; i++)
+    {
+        u32 index = (timer_jiffies + i) & TVR_MASK;
+        // 需要从高层降级，这时必须处理
+        if (!index)
+            return i;
+        if (!list_empty(&tv1[index]))
+            return i;
+    }
+    return max;
+}
+
+void timer_init()
+{
+    for (size_t i = 0; i < TVR_SIZE; i++)
+    {
+        list_init(&tv1[i]);
+    }
+    for (size_t level = 0; level < TVN_LEVELS; level++)
+    {
+        for (size_t i = 0; i < TVN_SIZE; i++)
+        {
+            list_init(&tvn[level][i]);
+        }
+    }
+    timer_jiffies = jiffies;
+}
+
+#define TIMER_TEST_PER_LEVEL 32
+#define TIMER_TEST_COUNT ((TVN_LEVELS + 1) * TIMER_TEST_PER_LEVEL)
+
+static timer_t test_timers[TIMER_TEST_COUNT];
+static u32 test_fired;
+
+static void test_timer_func(timer_t *timer)
+{
+    // 必须在 jiffies 正好等于到期时间的那个时钟周期处理
+    assert(timer->expires == jiffies);
+    assert(timer->data == (void *)true);
+    timer->data = (void *)false;
+    test_fired++;
+}
+
+// 定时器所在的槽，从链表结点找到链表头
+static list_t *timer_vec(timer_t *timer)
+{
+    list_node_t *node = &timer->node;
+    while (node->prev)
+    {
+        node = node->prev;
+    }
+    return element_entry(list_t, head, node);
+}
+
+// 定时器所在的层，第一层为 0
+static u32 timer_level(timer_t *timer)
+{
+    list_t *vec = timer_vec(timer);
+    if (vec >= tv1 && vec < tv1 + TVR_SIZE)
+    {
+        return 0;
+    }
+    assert(vec >= tvn[0] && vec < tvn[0] + TVN_LEVELS * TVN_SIZE);
+    return (vec - tvn[0]) / TVN_SIZE + 1;
+}
+
+// 第 level 层能放下的最小偏移
+static u32 level_start(u32 level)
+{
+    return level ? 1 << (TVR_BITS + (level - 1) * TVN_BITS) : 0;
+}
+
+static u32 test_seed = 1;
+
+static u32 test_rand()
+{
+    test_seed = test_seed * 1103515245 + 12345;
+    return test_seed >> 4;
+}
+
+// 检查时间轮每一层的插入、降级、删除、修改和到期时间
+// 需要在时钟中断开启之前调用，会修改 jiffies，最高层的定时器要走过 2^26 个时钟周期
+void timer_test()
+{
+    assert(!get_interrupt_state());
+    u32 saved = jiffies;
+
+    // 从回绕之前开始，最高层的定时器在 0 之后到期
+    jiffies = -(1 << 25);
+    timer_jiffies = jiffies;
+
+    u32 expected = 0;
+    for (size_t level = 0; level <= TVN_LEVELS; level++)
+    {
+        u32 start = level_start(level);
+        // 最高层只使用开始的一段，限制测试需要走过的周期数
+        u32 span = level < TVN_LEVELS ? level_start(level + 1) - start : 1 << 20;
+        for (size_t i = 0; i < TIMER_TEST_PER_LEVEL; i++)
+        {
+            timer_t *timer = &test_timers[level * TIMER_TEST_PER_LEVEL + i];
+            // 每层包括边界上的偏移
+            u32 offset = start + (i == 0 ? 0 : i == 1 ? span - 1 : test_rand() % span);
+            timer_setup(timer, test_timer_func, (void *)true);
+            timer_add(timer, jiffies + offset);
+            assert(timer_level(timer) == level);
+            expected++;
+        }
+    }
+
+    // 每层删除一个，修改一个到另一层
+    for (size_t level = 0; level <= TVN_LEVELS; level++)
+    {
+        timer_t *timer = &test_timers[level * TIMER_TEST_PER_LEVEL + 2];
+        timer_del(timer);
+        assert(!timer_pending(timer));
+        timer_del(timer);
+        timer->data = (void *)false;
+        expected--;
+
+        timer = &test_timers[level * TIMER_TEST_PER_LEVEL + 3];
+        u32 other = (level + 2) % (TVN_LEVELS + 1);
+        timer_mod(timer, jiffies + level_start(other) + test_rand() % 200);
+        assert(timer_level(timer) == other);
+    }
+
+    // 像空闲时一样跳过没有定时器的周期
+    while (test_fired < expected)
+    {
+        u32 skip = timer_next(TVR_SIZE);
+        jiffies += skip;
+        timer_run();
+        jiffies++;
+    }
+
+    for (size_t i = 0; i < TIMER_TEST_COUNT; i++)
+    {
+        assert(!timer_pending(&test_timers[i]));
+        assert(test_timers[i].data == (void *)false);
+    }
+    for (size_t i = 0; i < TVR_SIZE; i++)
+    {
+        assert(list_empty(&tv1[i]));
+    }
+
+    jiffies = saved;
+    timer_jiffies = jiffies;
+    LOGK("timer test ok, %d timers\n", expected);
+}
@@ -2,13 +2,58 @@
 #include <onix/string.h>
 #include <onix/onix.h>
 #include <onix/assert.h>
+#include <onix/stdlib.h>
+
+// 位图第 widx 个 32 位字，越界的位视为已占用
+static u32 bitmap_word(bitmap_t *map, u32 widx)
+{
+    u32 bytes = widx * 4;
+    if (bytes + 4 <= map->length)
+    {
+        return *(u32 *)(map->bits + bytes);
+    }
+
+    u32 word = 0xffffffff;
+    for (size_t i = 0; bytes + i < map->length; i++)
+    {
+        word &= ~(0xff << (i * 8));
+        word |= map->bits[bytes + i] << (i * 8);
+    }
+    return word;
+}
+
+// 位图的字数
+static u32 bitmap_words(bitmap_t *map)
+{
+    return div_round_up(map->length, 4);
+}
+
+// 更新第 first 到 last 个字在摘要中的位
+static void bitmap_summary_update(bitmap_t *map, u32 first, u32 last)
+{
+    for (u32 widx = first; widx <= last; widx++)
+    {
+        u32 mask = 1 << (widx % 32);
+        if (bitmap_word(map, widx) != 0xffffffff)
+            map->summary[widx / 32] |= mask;
+        else
+            map->summary[widx / 32] &= ~mask;
+    }
+}
 
 // 构造位图
 void bitmap_make(bitmap_t *map, char *bits, u32 length, u32 offset)
 {
+    assert(length <= BITMAP_SUMMARY_WORDS * 32 * 4);
     map->bits = bits;
     map->length = length;
     map->offset = offset;
+
+    memset(map->summary, 0, sizeof(map->summary));
+    if (length)
+    {
+        bitmap_summary_update(map, 0, bitmap_words(map) - 1);
+    }
 }
 
 // 位图初始化，全部置为 0
@@ -38,17 +83,9 @@ bool bitmap_test(bitmap_t *map, idx_t index)
     return (map->bits[bytes] & (1 << bits));
 }
 
-// 设置位图某位的值
-void bitmap_set(bitmap_t *map, idx_t index, bool value)
+// 设置位图某位的值，不更新摘要
+static void bitmap_set_bit(bitmap_t *map, idx_t idx, bool value)
 {
-    // value 必须是二值的
-    assert(value == 0 || value == 1);
-
-    assert(index >= map->offset);
-
-    // 得到位图的索引
-    idx_t idx = index - map->offset;
-
     // 位图数组中的字节
     u32 bytes = idx / 8;
 
@@ -66,37 +103,125 @@ void bitmap_set(bitmap_t *map, idx_t index, bool value)
     }
 }
 
+// 设置位图某位的值
+void bitmap_set(bitmap_t *map, idx_t index, bool value)
+{
+    // value 必须是二值的
+    assert(value == 0 || value == 1);
+
+    assert(index >= map->offset);
+
+    // 得到位图的索引
+    idx_t idx = index - map->offset;
+    assert(idx / 8 < map->length);
+
+    bitmap_set_bit(map, idx, value);
+    bitmap_summary_update(map, idx / 32, idx / 32);
+}
+
+// 将 index 开始的 count 位全部置为 value
+static void bitmap_fill(bitmap_t *map, idx_t index, u32 count, bool value)
+{
+    assert(index >= map->offset);
+
+    idx_t idx = index - map->offset;
+    assert(idx + count <= map->length * 8);
+    if (!count)
+    {
+        return;
+    }
+    u32 first = idx / 32;
+    u32 last = (idx + count - 1) / 32;
+
+    // 开头不足一个字节的部分
+    while (count > 0 && (idx % 8))
+    {
+        bitmap_set_bit(map, idx, value);
+        idx++;
+        count--;
+    }
+
+    // 中间整字节的部分
+    u32 bytes = count / 8;
+    memset(map->bits + idx / 8, value ? 0xff : 0, bytes);
+    idx += bytes * 8;
+    count -= bytes * 8;
+
+    // 结尾不足一个字节的部分
+    while (count--)
+    {
+        bitmap_set_bit(map, idx, value);
+        idx++;
+    }
+
+    bitmap_summary_update(map, first, last);
+}
+
+// 将 index 开始的 count 位置为 1
+void bitmap_set_range(bitmap_t *map, idx_t index, u32 count)
+{
+    bitmap_fill(map, index, count, true);
+}
+
+// 将 index 开始的 count 位置为 0
+void bitmap_clear_range(bitmap_t *map, idx_t index, u32 count)
+{
+    bitmap_fill(map, index, count, false);
+}
+
 // 从位图中得到连续的 count 位
 int bitmap_scan(bitmap_t *map, u32 count)
 {
-    int start = EOF;                 // 标记目标开始的位置
-    u32 bits_left = map->length * 8; // 剩余的位数
-    u32 next_bit = 0;                // 下一个位
-    u32 counter = 0;                 // 计数器
+    assert(count > 0);
 
-    // 从头开始找
-    while (bits_left-- > 0)
+    int start = EOF;              // 标记目标开始的位置
+    u32 words = bitmap_words(map); // 位图的字数
+    u32 counter = 0;              // 当前连续空闲位的计数
+    u32 widx = 0;
+
+    while (widx < words && start == EOF)
     {
-        if (!bitmap_test(map, map->offset + next_bit))
+        // 摘要中该字之后还有空闲位的字
+        u32 pending = map->summary[widx / 32] >> (widx % 32);
+        if (!pending)
         {
-            // 如果下一个位没有占用，则计数器加一
-            counter++;
+            // 这一组剩余的字全部被占用
+            counter = 0;
+            widx = (widx / 32 + 1) * 32;
+            continue;
         }
-        else
+
+        u32 skip = __builtin_ctz(pending);
+        if (skip)
         {
-            // 否则计数器置为 0，继续寻找
+            // 跳过被占用的字
             counter = 0;
+            widx += skip;
         }
 
-        // 下一位，位置加一
-        next_bit++;
-
-        // 找到数量一致，则设置开始的位置，结束
-        if (counter == count)
+        u32 word = bitmap_word(map, widx);
+        u32 bit = 0;
+        while (bit < 32)
         {
-            start = next_bit - count;
-            break;
+            u32 rest = word >> bit;
+            // 剩余的位全部空闲
+            u32 zeros = rest ? __builtin_ctz(rest) : 32 - bit;
+            counter += zeros;
+            bit += zeros;
+            if (counter >= count)
+            {
+                start = widx * 32 + bit - counter;
+                break;
+            }
+            if (bit == 32)
+            {
+                break;
+            }
+            // 跳过连续被占用的位
+            bit += __builtin_ctz(~rest);
+            counter = 0;
         }
+        widx++;
     }
 
     // 如果没找到，则返回 EOF(END OF FILE)
@@ -104,19 +229,14 @@ int bitmap_scan(bitmap_t *map, u32 count)
         return EOF;
 
     // 否则将找到的位，全部置为 1
-    bits_left = count;
-    next_bit = start;
-    while (bits_left--)
-    {
-        bitmap_set(map, map->offset + next_bit, true);
-        next_bit++;
-    }
+    bitmap_set_range(map, map->offset + start, count);
 
     // 然后返回索引
     return start + map->offset;
 }
 
 #include <onix/debug.h>
+#include <onix/time.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
@@ -137,4 +257,75 @@ void bitmap_tests()
         }
         LOGK("%d\n", idx);
     }
-}
\ No newline at end of file
+}
+
+// 逐位扫描，用于和按字扫描比较
+static int bitmap_scan_bitwise(bitmap_t *map, u32 count)
+{
+    int start = EOF;
+    u32 bits_left = map->length * 8;
+    u32 next_bit = 0;
+    u32 counter = 0;
+
+    while (bits_left-- > 0)
+    {
+        if (!bitmap_test(map, map->offset + next_bit))
+            counter++;
+        else
+            counter = 0;
+        next_bit++;
+        if (counter == count)
+        {
+            start = next_bit - count;
+            break;
+        }
+    }
+
+    if (start == EOF)
+        return EOF;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        bitmap_set(map, map->offset + start + i, true);
+    }
+    return start + map->offset;
+}
+
+#define BENCH_LEN 0x400
+#define BENCH_ROUNDS 16
+
+static u8 bench_buf[BENCH_LEN];
+
+// 位图前 7/8 被占用，分别用两种方式扫描和释放
+void bitmap_bench()
+{
+    bitmap_t bench;
+    u64 bitwise = 0;
+    u64 wordwise = 0;
+    u32 used = BENCH_LEN * 7;
+
+    for (size_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        bitmap_init(&bench, bench_buf, BENCH_LEN, 0);
+        for (size_t j = 0; j < used; j++)
+        {
+            bitmap_set(&bench, j, true);
+        }
+
+        u64 start = rdtsc();
+        idx_t idx = bitmap_scan_bitwise(&bench, 64);
+        for (size_t j = 0; j < 64; j++)
+        {
+            bitmap_set(&bench, idx + j, false);
+        }
+        bitwise += rdtsc() - start;
+
+        start = rdtsc();
+        assert(bitmap_scan(&bench, 64) == idx);
+        bitmap_clear_range(&bench, idx, 64);
+        wordwise += rdtsc() - start;
+    }
+
+    LOGK("bitmap bench bitwise %d cycles, wordwise %d cycles\n",
+         (u32)(bitwise / BENCH_ROUNDS), (u32)(wordwise / BENCH_ROUNDS));
+}
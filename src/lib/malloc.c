@@ -0,0 +1,241 @@
+#include <onix/stdlib.h>
+#include <onix/memory.h>
+#include <onix/syscall.h>
+
+// 用户态堆内存分配
+// 堆状态保存在堆的第一页，随进程的内存一起 fork
+// 小块按大小分级，释放后放回对应的链表
+// 大块按地址排序并合并相邻空闲块，堆顶空闲过多时通过 brk 归还
+
+#define HEAP_MAGIC 0x20220828
+#define HEAP_ALIGN 16
+#define BIN_COUNT 8
+#define BIN_MIN_SHIFT 4                                // 最小的块 16 字节
+#define BIN_MAX_SIZE (1 << (BIN_MIN_SHIFT + BIN_COUNT - 1)) // 最大的小块 2K
+#define HEAP_TRIM_SIZE (4 * PAGE_SIZE)                 // 堆顶空闲超过时归还
+
+// 块头，size 包括块头
+typedef struct chunk_t
+{
+    u32 size;
+    u32 magic;
+    struct chunk_t *next; // 空闲时有效
+} chunk_t;
+
+#define CHUNK_HEADER 8
+
+typedef struct heap_t
+{
+    u32 magic;
+    u32 lock;
+    u32 top; // 还没有分配过的内存开始的位置
+    u32 brk; // 当前的 brk
+    chunk_t *bins[BIN_COUNT];
+    chunk_t *large; // 按地址排序的空闲大块
+} heap_t;
+
+static heap_t *const heap = (heap_t *)KERNEL_MEMORY_SIZE;
+
+static u32 round_up(u32 value, u32 align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+static void heap_lock()
+{
+    u32 locked = 1;
+    while (true)
+    {
+        locked = 1;
+        asm volatile("xchgl %0, %1\n"
+                     : "+r"(locked), "+m"(heap->lock)::"memory");
+        if (!locked)
+            return;
+        yield();
+    }
+}
+
+static void heap_unlock()
+{
+    asm volatile("movl $0, %0\n" : "=m"(heap->lock)::"memory");
+}
+
+static void heap_init()
+{
+    heap->magic = HEAP_MAGIC;
+    heap->lock = 0;
+    heap->top = round_up((u32)heap + sizeof(heap_t), HEAP_ALIGN);
+    heap->brk = USER_HEAP_START;
+    for (size_t i = 0; i < BIN_COUNT; i++)
+    {
+        heap->bins[i] = NULL;
+    }
+    heap->large = NULL;
+}
+
+// 从堆顶切出 size 字节，不够时扩展 brk
+static chunk_t *heap_carve(u32 size)
+{
+    u32 end = heap->top + size;
+    if (end > heap->brk)
+    {
+        u32 brk_addr = round_up(end, PAGE_SIZE);
+        if (brk((void *)brk_addr) < 0)
+            return NULL;
+        heap->brk = brk_addr;
+    }
+    chunk_t *chunk = (chunk_t *)heap->top;
+    heap->top = end;
+    chunk->size = size;
+    return chunk;
+}
+
+// 堆顶空闲内存过多时归还给系统
+static void heap_trim()
+{
+    u32 brk_addr = round_up(heap->top, PAGE_SIZE);
+    if (heap->brk - brk_addr < HEAP_TRIM_SIZE)
+        return;
+    if (brk((void *)brk_addr) < 0)
+        return;
+    heap->brk = brk_addr;
+}
+
+static u32 bin_index(u32 size)
+{
+    u32 idx = 0;
+    while ((1 << (BIN_MIN_SHIFT + idx)) < size)
+    {
+        idx++;
+    }
+    return idx;
+}
+
+static chunk_t *small_alloc(u32 size)
+{
+    u32 idx = bin_index(size);
+    chunk_t *chunk = heap->bins[idx];
+    if (chunk)
+    {
+        heap->bins[idx] = chunk->next;
+        return chunk;
+    }
+    return heap_carve(1 << (BIN_MIN_SHIFT + idx));
+}
+
+// 首次适配，剩余足够大时分割
+static chunk_t *large_alloc(u32 size)
+{
+    chunk_t **prev = &heap->large;
+    for (chunk_t *chunk = heap->large; chunk; prev = &chunk->next, chunk = chunk->next)
+    {
+        if (chunk->size < size)
+            continue;
+
+        if (chunk->size - size > BIN_MAX_SIZE)
+        {
+            chunk_t *rest = (chunk_t *)((u32)chunk + size);
+            rest->size = chunk->size - size;
+            rest->next = chunk->next;
+            *prev = rest;
+            chunk->size = size;
+        }
+        else
+        {
+            *prev = chunk->next;
+        }
+        return chunk;
+    }
+    return heap_carve(size);
+}
+
+static u32 chunk_end(chunk_t *chunk)
+{
+    return (u32)chunk + chunk->size;
+}
+
+// 放回按地址排序的链表，并与前后相邻的空闲块合并
+static void large_free(chunk_t *chunk)
+{
+    chunk_t **link = &heap->large;
+    chunk_t **prev_link = NULL;
+    while (*link && *link < chunk)
+    {
+        prev_link = link;
+        link = &(*link)->next;
+    }
+
+    chunk_t *next = *link;
+    if (next && chunk_end(chunk) == (u32)next)
+    {
+        chunk->size += next->size;
+        next = next->next;
+    }
+    chunk->next = next;
+    *link = chunk;
+
+    if (prev_link && chunk_end(*prev_link) == (u32)chunk)
+    {
+        chunk_t *prev = *prev_link;
+        prev->size += chunk->size;
+        prev->next = chunk->next;
+        chunk = prev;
+        link = prev_link;
+    }
+
+    // 最后的空闲块挨着堆顶，还给堆顶
+    if (!chunk->next && chunk_end(chunk) == heap->top)
+    {
+        *link = NULL;
+        heap->top = (u32)chunk;
+        heap_trim();
+    }
+}
+
+void *malloc(size_t size)
+{
+    if (!size)
+        return NULL;
+
+    if (heap->magic != HEAP_MAGIC)
+        heap_init();
+
+    heap_lock();
+    u32 need = round_up(size + CHUNK_HEADER, HEAP_ALIGN);
+    chunk_t *chunk;
+    if (need <= BIN_MAX_SIZE)
+        chunk = small_alloc(need);
+    else
+        chunk = large_alloc(need);
+    if (chunk)
+        chunk->magic = HEAP_MAGIC;
+    heap_unlock();
+
+    if (!chunk)
+        return NULL;
+    return (void *)((u32)chunk + CHUNK_HEADER);
+}
+
+void free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    chunk_t *chunk = (chunk_t *)((u32)ptr - CHUNK_HEADER);
+    if (chunk->magic != HEAP_MAGIC)
+        return;
+
+    heap_lock();
+    chunk->magic = 0;
+    if (chunk->size <= BIN_MAX_SIZE)
+    {
+        u32 idx = bin_index(chunk->size);
+        chunk->next = heap->bins[idx];
+        heap->bins[idx] = chunk;
+    }
+    else
+    {
+        large_free(chunk);
+    }
+    heap_unlock();
+}
@@ -0,0 +1,248 @@
+#include <onix/rbtree.h>
+#include <onix/assert.h>
+
+// 初始化红黑树
+void rb_init(rb_root_t *root)
+{
+    root->node = NULL;
+    root->leftmost = NULL;
+}
+
+// 把 node 所在的位置替换成 child
+static void rb_replace(rb_root_t *root, rb_node_t *node, rb_node_t *child)
+{
+    rb_node_t *parent = node->parent;
+    if (!parent)
+        root->node = child;
+    else if (parent->left == node)
+        parent->left = child;
+    else
+        parent->right = child;
+    if (child)
+        child->parent = parent;
+}
+
+// 左旋，node 的右孩子成为其父结点
+static void rb_rotate_left(rb_root_t *root, rb_node_t *node)
+{
+    rb_node_t *right = node->right;
+    node->right = right->left;
+    if (right->left)
+        right->left->parent = node;
+    rb_replace(root, node, right);
+    right->left = node;
+    node->parent = right;
+}
+
+// 右旋，node 的左孩子成为其父结点
+static void rb_rotate_right(rb_root_t *root, rb_node_t *node)
+{
+    rb_node_t *left = node->left;
+    node->left = left->right;
+    if (left->right)
+        left->right->parent = node;
+    rb_replace(root, node, left);
+    left->right = node;
+    node->parent = left;
+}
+
+static bool rb_is_red(rb_node_t *node)
+{
+    return node && node->color == RB_RED;
+}
+
+void rb_insert(rb_root_t *root, rb_node_t *node, rb_node_t *parent, rb_node_t **link, bool leftmost)
+{
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+    if (leftmost)
+        root->leftmost = node;
+
+    // 父结点是红色时需要调整
+    while (rb_is_red(node->parent))
+    {
+        parent = node->parent;
+        rb_node_t *gparent = parent->parent;
+        if (parent == gparent->left)
+        {
+            rb_node_t *uncle = gparent->right;
+            if (rb_is_red(uncle))
+            {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right)
+            {
+                rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_right(root, gparent);
+        }
+        else
+        {
+            rb_node_t *uncle = gparent->left;
+            if (rb_is_red(uncle))
+            {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left)
+            {
+                rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_left(root, gparent);
+        }
+    }
+    root->node->color = RB_BLACK;
+}
+
+// 删除黑色结点后，从 node (可能为空) 及其父结点 parent 开始调整
+static void rb_erase_fixup(rb_root_t *root, rb_node_t *node, rb_node_t *parent)
+{
+    while (node != root->node && !rb_is_red(node))
+    {
+        if (node == parent->left)
+        {
+            rb_node_t *sibling = parent->right;
+            if (rb_is_red(sibling))
+            {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right))
+            {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->right))
+            {
+                sibling->left->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_right(root, sibling);
+                sibling = parent->right;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+            node = root->node;
+        }
+        else
+        {
+            rb_node_t *sibling = parent->left;
+            if (rb_is_red(sibling))
+            {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right))
+            {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->left))
+            {
+                sibling->right->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_left(root, sibling);
+                sibling = parent->left;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+            node = root->node;
+        }
+    }
+    if (node)
+        node->color = RB_BLACK;
+}
+
+void rb_erase(rb_root_t *root, rb_node_t *node)
+{
+    if (root->leftmost == node)
+        root->leftmost = rb_next(node);
+
+    rb_node_t *child;
+    rb_node_t *parent;
+    u32 color;
+
+    if (!node->left || !node->right)
+    {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        color = node->color;
+        rb_replace(root, node, child);
+    }
+    else
+    {
+        // 用后继结点替换 node
+        rb_node_t *next = node->right;
+        while (next->left)
+            next = next->left;
+
+        child = next->right;
+        color = next->color;
+        if (next->parent == node)
+        {
+            parent = next;
+        }
+        else
+        {
+            parent = next->parent;
+            rb_replace(root, next, child);
+            next->right = node->right;
+            next->right->parent = next;
+        }
+        rb_replace(root, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+        next->color = node->color;
+    }
+
+    if (color == RB_BLACK)
+        rb_erase_fixup(root, child, parent);
+
+    node->parent = NULL;
+    node->left = NULL;
+    node->right = NULL;
+}
+
+// 中序遍历的下一个结点
+rb_node_t *rb_next(rb_node_t *node)
+{
+    if (node->right)
+    {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
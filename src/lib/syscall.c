@@ -57,6 +57,17 @@ pid_t fork()
     return _syscall0(SYS_NR_FORK);
 }
 
+// spawn 子进程的入口，内核把要执行的函数和参数放在栈上，不会返回
+static void spawn_start(int (*entry)(void *), void *arg)
+{
+    exit(entry(arg));
+}
+
+pid_t spawn(int (*entry)(void *), void *arg)
+{
+    return _syscall3(SYS_NR_SPAWN, (u32)spawn_start, (u32)entry, (u32)arg);
+}
+
 void yield()
 {
   _syscall0(SYS_NR_YIELD);
@@ -67,6 +78,11 @@ void sleep(u32 ms)
     _syscall1(SYS_NR_SLEEP, ms);
 }
 
+pid_t waitpid(pid_t pid, int32 *status)
+{
+    return _syscall2(SYS_NR_WAITPID, pid, (u32)status);
+}
+
 pid_t getpid()
 {
     return _syscall0(SYS_NR_GETPID);
@@ -86,4 +102,10 @@ int32 brk(void *addr)
 int32 write(fd_t fd, char *buf, u32 len)
 {
     return _syscall3(SYS_NR_WRITE, fd, (u32)buf, len);
+}
+
+// 打印内核 kmalloc 的使用情况
+void kmstat()
+{
+    _syscall0(SYS_NR_KMSTAT);
 }
\ No newline at end of file